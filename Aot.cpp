@@ -0,0 +1,64 @@
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//Aot backend. Runs C++ that chip8-aot generated from the loaded ROM, and the tables wherever
+//that code doesn't reach: addresses it never found, Bnnn targets it couldn't follow, and
+//everything after the program writes over its own code.
+
+namespace {
+
+    //Function-local so registration from other files' static initializers can't run before it exists.
+    std::vector<AotProgram const*>& Programs(){
+        static std::vector<AotProgram const*> programs;
+        return programs;
+    }
+
+}
+
+    bool RegisterAotProgram(AotProgram const* program){
+        Programs().push_back(program);
+        return true;
+    }
+
+    AotProgram const* Chip8::Ops::FindAot(uint8_t const* rom, size_t size){
+        for (AotProgram const* program : Programs()){
+            if (program->size == size && std::memcmp(program->rom, rom, size) == 0){
+                return program;
+            }
+        }
+        return nullptr;
+    }
+
+    uint64_t Chip8::Ops::RunAot(Chip8& c, uint64_t count){
+        uint64_t const budget = count;
+
+        while (count > 0 && c.aot && !c.waitingForKey){
+            uint64_t executed = c.aot->run(c, count);
+
+            //Somewhere the translation has no code for, step over it and try again.
+            if (executed == 0 && !c.waitingForKey){
+                executed = RunTables(c, 1);
+            }
+            count -= executed;
+        }
+
+        if (!c.waitingForKey){
+            count -= RunTables(c, count);
+        }
+        return budget - count;
+    }
+
+    //The translation is dropped for good once anything it was made from changes.
+    void Chip8::Ops::InvalidateAot(Chip8& c, unsigned int address, unsigned int length){
+        for (unsigned int i = 0; i < std::min(length, MEMORY_SIZE); i++){
+            unsigned int byte = (address + i) & (MEMORY_SIZE - 1);
+
+            if (c.aot->code[byte / 8] & (1u << (byte % 8))){
+                c.aot = nullptr;
+                return;
+            }
+        }
+    }
@@ -0,0 +1,297 @@
+/*
+    chip8-aot: translates a ROM to a C++ file for the Aot dispatch backend. Code is found by
+    following every path from the start address through jumps, calls and both sides of skips,
+    and each instruction found becomes a few lines calling Chip8::Ops with its operands as
+    constants, so the compiler can fold them. 00EE and Bnnn go through a switch on pc, which
+    hands anything it doesn't know back to the interpreter.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+
+namespace {
+
+    struct Translation {
+        std::vector<uint8_t> memory = std::vector<uint8_t>(MEMORY_SIZE);
+        std::vector<bool> instruction = std::vector<bool>(MEMORY_SIZE);     //An instruction starts here.
+        std::vector<bool> code = std::vector<bool>(MEMORY_SIZE);            //Byte of a found instruction.
+        unsigned int romEnd = START_ADDRESS;
+        unsigned int instructions = 0;
+        unsigned int indirect = 0;
+    };
+
+    uint16_t Fetch(Translation const& t, unsigned int address){
+        return static_cast<uint16_t>((t.memory[address] << 8u) | t.memory[address + 1]);
+    }
+
+    bool IsSkip(uint16_t opcode){
+        switch (opcode >> 12u){
+            case 0x3:
+            case 0x4:
+            case 0x5:
+            case 0x9:
+                return true;
+            case 0xE:
+                return (opcode & 0x000Fu) == 0x1 || (opcode & 0x000Fu) == 0xE;
+        }
+        return false;
+    }
+
+    //Only the ROM image is translated: everything else in memory can change without a trace.
+    void Recover(Translation& t){
+        std::vector<unsigned int> pending{START_ADDRESS};
+
+        while (!pending.empty()){
+            unsigned int address = pending.back();
+            pending.pop_back();
+
+            if (address < START_ADDRESS || address + 2 > t.romEnd || t.instruction[address]){
+                continue;
+            }
+
+            uint16_t opcode = Fetch(t, address);
+            t.instruction[address] = true;
+            t.code[address] = true;
+            t.code[address + 1] = true;
+            t.instructions++;
+
+            switch (opcode >> 12u){
+                case 0x0:
+                    if ((opcode & 0x000Fu) != 0xE){
+                        pending.push_back(address + 2);
+                    }
+                    break;
+                case 0x1:
+                    pending.push_back(opcode & 0x0FFFu);
+                    break;
+                case 0x2:
+                    pending.push_back(opcode & 0x0FFFu);
+                    pending.push_back(address + 2);
+                    break;
+                case 0xB:
+                    t.indirect++;
+                    break;
+                default:
+                    pending.push_back(address + 2);
+                    if (IsSkip(opcode)){
+                        pending.push_back(address + 4);
+                    }
+                    break;
+            }
+        }
+    }
+
+    std::string Hex(unsigned int value, int digits = 3){
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+        return buffer;
+    }
+
+    std::string Label(unsigned int address){
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "a%03X", address);
+        return buffer;
+    }
+
+    //Carries on at target, or leaves it to the interpreter if it wasn't translated.
+    std::string Goto(Translation const& t, unsigned int target){
+        if (target < MEMORY_SIZE && t.instruction[target]){
+            return "goto " + Label(target) + ";";
+        }
+        return "{ Ops::Jump(c, " + Hex(target) + "); return n; }";
+    }
+
+    //The statements for one instruction. Sets fallsThrough when it can carry on to address + 2.
+    std::string Body(Translation const& t, unsigned int address, uint16_t opcode, bool& fallsThrough){
+        std::string x = std::to_string((opcode & 0x0F00u) >> 8u);
+        std::string y = std::to_string((opcode & 0x00F0u) >> 4u);
+        std::string n = std::to_string(opcode & 0x000Fu);
+        std::string kk = Hex(opcode & 0x00FFu, 2);
+        std::string nnn = Hex(opcode & 0x0FFFu);
+        std::string next = Hex(address + 2);
+        std::string skip = Goto(t, address + 4);
+
+        fallsThrough = true;
+
+        switch (opcode >> 12u){
+            case 0x0:
+                switch (opcode & 0x000Fu){
+                    case 0x0: return "Ops::Cls(c);";
+                    case 0xE: fallsThrough = false; return "Ops::Ret(c); goto dispatch;";
+                }
+                return "";
+            case 0x1:
+                fallsThrough = false;
+                return Goto(t, opcode & 0x0FFFu);
+            case 0x2:
+                fallsThrough = false;
+                return "Ops::Jump(c, " + next + "); Ops::Call(c, " + nnn + "); " + Goto(t, opcode & 0x0FFFu);
+            case 0x3: return "if (Ops::V(c, " + x + ") == " + kk + ") " + skip;
+            case 0x4: return "if (Ops::V(c, " + x + ") != " + kk + ") " + skip;
+            case 0x5: return "if (Ops::V(c, " + x + ") == Ops::V(c, " + y + ")) " + skip;
+            case 0x6: return "Ops::Set(c, " + x + ", " + kk + ");";
+            case 0x7: return "Ops::AddImmediate(c, " + x + ", " + kk + ");";
+            case 0x8:
+                switch (opcode & 0x000Fu){
+                    case 0x0: return "Ops::Move(c, " + x + ", " + y + ");";
+                    case 0x1: return "Ops::Or(c, " + x + ", " + y + ");";
+                    case 0x2: return "Ops::And(c, " + x + ", " + y + ");";
+                    case 0x3: return "Ops::Xor(c, " + x + ", " + y + ");";
+                    case 0x4: return "Ops::Add(c, " + x + ", " + y + ");";
+                    case 0x5: return "Ops::Sub(c, " + x + ", " + y + ");";
+                    case 0x6: return "Ops::ShiftRight(c, " + x + ");";
+                    case 0x7: return "Ops::SubReverse(c, " + x + ", " + y + ");";
+                    case 0xE: return "Ops::ShiftLeft(c, " + x + ");";
+                }
+                return "";
+            case 0x9: return "if (Ops::V(c, " + x + ") != Ops::V(c, " + y + ")) " + skip;
+            case 0xA: return "Ops::SetIndex(c, " + nnn + ");";
+            case 0xB:
+                fallsThrough = false;
+                return "Ops::JumpOffset(c, " + nnn + "); goto dispatch;";
+            case 0xC: return "Ops::Random(c, " + x + ", " + kk + ");";
+            case 0xD: return "Ops::Draw(c, " + x + ", " + y + ", " + n + ");";
+            case 0xE:
+                switch (opcode & 0x000Fu){
+                    case 0x1: return "if (!Ops::KeyDown(c, " + x + ")) " + skip;
+                    case 0xE: return "if (Ops::KeyDown(c, " + x + ")) " + skip;
+                }
+                return "";
+            case 0xF:
+                switch (opcode & 0x00FFu){
+                    case 0x07: return "Ops::GetDelay(c, " + x + ");";
+                    case 0x0A: return "Ops::Jump(c, " + next + "); Ops::WaitKey(c, " + x + "); if (Ops::WaitingForKey(c)) return n - 1;";
+                    case 0x15: return "Ops::SetDelay(c, " + x + ");";
+                    case 0x18: return "Ops::SetSound(c, " + x + ");";
+                    case 0x1E: return "Ops::AddIndex(c, " + x + ");";
+                    case 0x29: return "Ops::FontCharacter(c, " + x + ");";
+                    case 0x33: return "Ops::Bcd(c, " + x + "); if (!Ops::AotLoaded(c)) { Ops::Jump(c, " + next + "); return n; }";
+                    case 0x55: return "Ops::Store(c, " + x + "); if (!Ops::AotLoaded(c)) { Ops::Jump(c, " + next + "); return n; }";
+                    case 0x65: return "Ops::Load(c, " + x + ");";
+                }
+                return "";
+        }
+        return "";
+    }
+
+    std::string Bytes(std::vector<uint8_t> const& bytes){
+        std::string out;
+
+        for (size_t i = 0; i < bytes.size(); i++){
+            out += (i % 16 == 0 ? "\n        " : " ") + Hex(bytes[i], 2) + ",";
+        }
+        return out;
+    }
+
+    void Emit(Translation const& t, std::string const& name, std::FILE* out){
+        std::vector<uint8_t> rom(t.memory.begin() + START_ADDRESS, t.memory.begin() + t.romEnd);
+        std::vector<uint8_t> code(MEMORY_SIZE / 8);
+
+        for (unsigned int i = 0; i < MEMORY_SIZE; i++){
+            code[i / 8] |= t.code[i] << (i % 8);
+        }
+
+        std::fprintf(out, "//Generated by chip8-aot from %s, do not edit.\n\n", name.c_str());
+        std::fprintf(out, "#include \"Chip8.hpp\"\n#include \"Chip8Ops.hpp\"\n\n");
+        std::fprintf(out, "namespace {\n\n    using Ops = Chip8::Ops;\n\n");
+        std::fprintf(out, "    uint8_t const rom[] = {%s\n    };\n\n", Bytes(rom).c_str());
+        std::fprintf(out, "    uint8_t const code[] = {%s\n    };\n\n", Bytes(code).c_str());
+
+        //00EE and Bnnn come back to the switch, a ROM without either only needs it on entry.
+        bool indirect = false;
+        for (unsigned int address = 0; address < MEMORY_SIZE; address++){
+            uint16_t opcode = t.instruction[address] ? Fetch(t, address) : 0;
+            indirect |= (opcode >> 12u) == 0xB || ((opcode >> 12u) == 0x0 && (opcode & 0x000Fu) == 0xE);
+        }
+
+        std::fprintf(out, "    uint64_t Run(Chip8& c, uint64_t budget){\n");
+        std::fprintf(out, "        uint64_t n = 0;\n\n");
+        if (indirect){
+            std::fprintf(out, "    dispatch:\n");
+        }
+        std::fprintf(out, "        switch (c.PC()){\n");
+        for (unsigned int address = 0; address < MEMORY_SIZE; address++){
+            if (t.instruction[address]){
+                std::fprintf(out, "            case %s: goto %s;\n", Hex(address).c_str(), Label(address).c_str());
+            }
+        }
+        std::fprintf(out, "            default: return n;\n        }\n\n");
+
+        std::vector<unsigned int> order;
+        for (unsigned int address = 0; address < MEMORY_SIZE; address++){
+            if (t.instruction[address]){
+                order.push_back(address);
+            }
+        }
+
+        for (size_t i = 0; i < order.size(); i++){
+            unsigned int address = order[i];
+            uint16_t opcode = Fetch(t, address);
+            bool fallsThrough;
+            std::string body = Body(t, address, opcode, fallsThrough);
+
+            std::fprintf(out, "    %s: //%04X\n", Label(address).c_str(), opcode);
+            std::fprintf(out, "        if (n == budget){ Ops::Jump(c, %s); return n; }\n", Hex(address).c_str());
+            std::fprintf(out, "        n++;\n");
+            if (!body.empty()){
+                std::fprintf(out, "        %s\n", body.c_str());
+            }
+            if (fallsThrough && (i + 1 == order.size() || order[i + 1] != address + 2)){
+                std::fprintf(out, "        %s\n", Goto(t, address + 2).c_str());
+            }
+        }
+
+        std::fprintf(out, "    }\n\n");
+        std::fprintf(out, "    AotProgram const program{\"%s\", rom, sizeof(rom), code, &Run};\n", name.c_str());
+        std::fprintf(out, "    [[maybe_unused]] bool const registered = RegisterAotProgram(&program);\n\n}\n");
+    }
+
+}
+
+int main(int argc, char** argv){
+    if (argc != 3){
+        std::cerr << "Usage: " << argv[0] << " <ROM> <output.cpp>\n";
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    std::vector<char> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (!file.good() && !file.eof()){
+        std::cerr << "Could not load ROM " << argv[1] << "\n";
+        return EXIT_FAILURE;
+    }
+    if (rom.empty() || rom.size() > MEMORY_SIZE - START_ADDRESS){
+        std::cerr << "ROM " << argv[1] << " doesn't fit in memory\n";
+        return EXIT_FAILURE;
+    }
+
+    Translation t;
+    std::copy(rom.begin(), rom.end(), t.memory.begin() + START_ADDRESS);
+    t.romEnd = START_ADDRESS + static_cast<unsigned int>(rom.size());
+    Recover(t);
+
+    std::FILE* out = std::fopen(argv[2], "w");
+    if (!out){
+        std::cerr << "Could not write " << argv[2] << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::string name = argv[1];
+    name = name.substr(name.find_last_of("/\\") + 1);
+    Emit(t, name, out);
+    std::fclose(out);
+
+    std::printf("%s: %u instructions translated, %u Bnnn left to the interpreter, %zu bytes\n",
+                name.c_str(), t.instructions, t.indirect, rom.size());
+    return 0;
+}
@@ -0,0 +1,407 @@
+/*
+    Batch runner for ROM corpora. Reads a job list, runs every job for its number of frames with its
+    scripted key presses on all cores, and writes one CSV row per job: the final frame hash, the
+    instructions retired and what the program was doing when the run ended.
+
+    Job list, one job per line, # starts a comment:
+        ROM FRAMES [SCRIPT]
+
+    Input script, one change of keypad state per line, # starts a comment:
+        FRAME KEYS
+    KEYS is a hex mask of the keys held from that frame on, bit n for key n, e.g. "120 0x0010"
+    holds key 4 from frame 120 until the next line. No keys are held before the first line.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Chip8.hpp"
+
+const unsigned int DEFAULT_IPF = 10;
+
+struct KeyChange {
+    uint64_t frame;
+    uint16_t keys;
+};
+
+struct Job {
+    std::string rom;
+    std::string script;
+    uint64_t frames;
+    std::vector<uint8_t> const* data;          //Shared by every job running the same ROM.
+    std::vector<KeyChange> const* changes;     //Likewise for the script, sorted by frame.
+};
+
+struct Result {
+    uint64_t frames{};
+    uint64_t instructions{};
+    uint64_t hash{};
+    char const* halt = "not-run";
+};
+
+struct Settings {
+    uint64_t instructionsPerFrame = DEFAULT_IPF;
+    uint32_t seed = 0;
+    Dispatch dispatch = Dispatch::CHIP8_DEFAULT_DISPATCH;
+    Quirks quirks;
+};
+
+static void Usage(char const* name){
+    std::cerr << "Usage: " << name << " [--threads N] [--ipf N] [--seed N] [--wrap-x] [--wrap-y] [--dispatch NAME] [--out FILE] <JOBS>\n";
+    std::cerr << "Dispatch:";
+    for (Dispatch dispatch : ALL_DISPATCHES){
+        std::cerr << " " << DispatchName(dispatch);
+    }
+    std::cerr << "\n";
+    std::exit(EXIT_FAILURE);
+}
+
+//All of text as a number that fits in T, in the given base. False for anything else, a sign included.
+template <typename T>
+static bool ParseNumber(std::string const& text, T& value, int base = 10){
+    size_t used = 0;
+    unsigned long long parsed;
+
+    if (text.empty() || text[0] == '-' || text[0] == '+'){
+        return false;
+    }
+    try {
+        parsed = std::stoull(text, &used, base);
+    }
+    catch (std::logic_error const&){
+        return false;
+    }
+    if (used != text.size() || parsed > std::numeric_limits<T>::max()){
+        return false;
+    }
+    value = static_cast<T>(parsed);
+    return true;
+}
+
+//Strips a # comment and splits what's left on whitespace.
+static std::vector<std::string> Fields(std::string line){
+    line = line.substr(0, line.find('#'));
+    std::istringstream stream(line);
+    return std::vector<std::string>(std::istream_iterator<std::string>(stream), std::istream_iterator<std::string>());
+}
+
+static bool ReadFile(std::string const& filename, std::vector<uint8_t>& data){
+    std::ifstream file(filename, std::ios::binary);
+
+    if (!file.is_open()){
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool ReadScript(std::string const& filename, std::vector<KeyChange>& changes){
+    std::ifstream file(filename);
+    std::string line;
+
+    if (!file.is_open()){
+        return false;
+    }
+
+    while (std::getline(file, line)){
+        std::vector<std::string> fields = Fields(line);
+
+        if (fields.empty()){
+            continue;
+        }
+        if (fields.size() != 2){
+            return false;
+        }
+        KeyChange change{};
+
+        if (!ParseNumber(fields[0], change.frame) || !ParseNumber(fields[1], change.keys, 16)){
+            return false;
+        }
+        changes.push_back(change);
+    }
+
+    std::stable_sort(changes.begin(), changes.end(), [](KeyChange const& a, KeyChange const& b){ return a.frame < b.frame; });
+    return true;
+}
+
+//Per-thread deques of job indices. A worker takes jobs from the back of its own deque and, once
+//that's empty, steals from the back of the others', where their longest job left is. Jobs are
+//whole ROM runs, so a lock per deque costs nothing next to the work, and a worker only touches
+//another's lock when it's idle.
+class WorkQueues {
+    public:
+        explicit WorkQueues(unsigned int workers) : queues(workers) {}
+
+        void Push(unsigned int worker, size_t job){
+            queues[worker].jobs.push_back(job);
+        }
+
+        bool Pop(unsigned int worker, size_t& job){
+            if (TakeBack(queues[worker], job)){
+                return true;
+            }
+            for (size_t i = 1; i < queues.size(); i++){
+                if (TakeBack(queues[(worker + i) % queues.size()], job)){
+                    steals.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+            //Nothing creates jobs once the workers start, so empty everywhere means done.
+            return false;
+        }
+
+        uint64_t Steals() const { return steals.load(); }
+
+    private:
+        //Own cache line each, so workers popping their own deques don't share one.
+        struct alignas(64) Queue {
+            std::mutex lock;
+            std::deque<size_t> jobs;
+        };
+
+        static bool TakeBack(Queue& queue, size_t& job){
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.jobs.empty()){
+                return false;
+            }
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+            return true;
+        }
+
+        std::vector<Queue> queues;
+        std::atomic<uint64_t> steals{0};
+};
+
+//Runs one job on an instance that has just been Reset().
+static Result RunJob(Chip8& chip8, Job const& job, Settings const& settings){
+    Result result;
+
+    if (!chip8.LoadROM(job.data->data(), job.data->size())){
+        result.halt = "load-failed";
+        return result;
+    }
+
+    std::vector<KeyChange> const& changes = *job.changes;
+    size_t next = 0;
+    Idle idle = Idle::None;
+
+    for (; result.frames < job.frames; result.frames++){
+        while (next < changes.size() && changes[next].frame <= result.frames){
+            for (unsigned int key = 0; key < KEY_COUNT; key++){
+                chip8.keypad[key] = (changes[next].keys >> key) & 1u;
+            }
+            next++;
+        }
+
+        RunStats stats = chip8.RunUntilFrameEnd(settings.instructionsPerFrame);
+        result.instructions += stats.instructions;
+        idle = stats.idle;
+
+        //Blocked in Fx0A with no key changes left in the script, it will never move again.
+        if (idle == Idle::WaitKey && next == changes.size()){
+            result.frames++;
+            break;
+        }
+    }
+
+    result.hash = chip8.FrameHash();
+    result.halt = IdleName(idle);
+    return result;
+}
+
+//Each worker has its own instance and Reset()s it between jobs rather than constructing a new
+//one, so the caches the backends build keep their allocations and the memory stays on its node.
+static void Worker(unsigned int id, WorkQueues& queues, std::vector<Job> const& jobs, std::vector<Result>& results, Settings const& settings){
+    std::unique_ptr<Chip8> chip8(new Chip8(settings.seed));
+    chip8->SetQuirks(settings.quirks);
+    chip8->SetDispatch(settings.dispatch);
+    size_t job;
+
+    while (queues.Pop(id, job)){
+        chip8->Reset(settings.seed);
+        results[job] = RunJob(*chip8, jobs[job], settings);
+    }
+}
+
+//Quotes a CSV field if it needs it.
+static std::string Csv(std::string const& field){
+    if (field.find_first_of(",\"\n") == std::string::npos){
+        return field;
+    }
+
+    std::string quoted = "\"";
+    for (char c : field){
+        quoted += c == '"' ? "\"\"" : std::string(1, c);
+    }
+    return quoted + "\"";
+}
+
+int main(int argc, char** argv){
+    Settings settings;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    char const* jobsFilename = nullptr;
+    char const* outFilename = nullptr;
+
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+
+        if (i + 1 < argc && arg == "--threads"){
+            if (!ParseNumber(argv[++i], threads)){
+                Usage(argv[0]);
+            }
+        }
+        else if (i + 1 < argc && arg == "--ipf"){
+            if (!ParseNumber(argv[++i], settings.instructionsPerFrame)){
+                Usage(argv[0]);
+            }
+        }
+        else if (i + 1 < argc && arg == "--seed"){
+            if (!ParseNumber(argv[++i], settings.seed)){
+                Usage(argv[0]);
+            }
+        }
+        else if (i + 1 < argc && arg == "--dispatch"){
+            if (!ParseDispatch(argv[++i], settings.dispatch)){
+                Usage(argv[0]);
+            }
+        }
+        else if (i + 1 < argc && arg == "--out"){
+            outFilename = argv[++i];
+        }
+        else if (arg == "--wrap-x"){
+            settings.quirks.horizontal = EdgeMode::Wrap;
+        }
+        else if (arg == "--wrap-y"){
+            settings.quirks.vertical = EdgeMode::Wrap;
+        }
+        else if (!jobsFilename && arg[0] != '-'){
+            jobsFilename = argv[i];
+        }
+        else {
+            Usage(argv[0]);
+        }
+    }
+
+    if (!jobsFilename || threads == 0 || settings.instructionsPerFrame == 0){
+        Usage(argv[0]);
+    }
+
+    //Every ROM and script is read once, up front, and shared read-only by the workers.
+    std::map<std::string, std::vector<uint8_t>> roms;
+    std::map<std::string, std::vector<KeyChange>> scripts;
+    std::vector<Job> jobs;
+    std::ifstream jobsFile(jobsFilename);
+    std::string line;
+
+    if (!jobsFile.is_open()){
+        std::cerr << "Could not open job list " << jobsFilename << "\n";
+        return EXIT_FAILURE;
+    }
+
+    scripts[""];
+    while (std::getline(jobsFile, line)){
+        std::vector<std::string> fields = Fields(line);
+
+        if (fields.empty()){
+            continue;
+        }
+        if (fields.size() < 2 || fields.size() > 3){
+            std::cerr << "Bad job: " << line << "\n";
+            return EXIT_FAILURE;
+        }
+
+        Job job{fields[0], fields.size() == 3 ? fields[2] : "", 0, nullptr, nullptr};
+
+        if (!ParseNumber(fields[1], job.frames)){
+            std::cerr << "Bad job: " << line << "\n";
+            return EXIT_FAILURE;
+        }
+
+        if (!roms.count(job.rom) && !ReadFile(job.rom, roms[job.rom])){
+            std::cerr << "Could not load ROM " << job.rom << "\n";
+            return EXIT_FAILURE;
+        }
+        if (!scripts.count(job.script) && !ReadScript(job.script, scripts[job.script])){
+            std::cerr << "Could not read input script " << job.script << "\n";
+            return EXIT_FAILURE;
+        }
+
+        job.data = &roms[job.rom];
+        job.changes = &scripts[job.script];
+        jobs.push_back(job);
+    }
+
+    threads = static_cast<unsigned int>(std::min<size_t>(threads, std::max<size_t>(jobs.size(), 1)));
+
+    //Dealt out so each deque ends with its longest job: workers and thieves both take from the
+    //back, so the long jobs start early and the short ones fill in the gaps.
+    std::vector<size_t> order(jobs.size());
+    for (size_t i = 0; i < order.size(); i++){
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return jobs[a].frames > jobs[b].frames; });
+
+    WorkQueues queues(threads);
+    for (size_t i = 0; i < order.size(); i++){
+        queues.Push(static_cast<unsigned int>(i % threads), order[order.size() - 1 - i]);
+    }
+
+    std::vector<Result> results(jobs.size());
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned int id = 0; id < threads; id++){
+        workers.emplace_back(Worker, id, std::ref(queues), std::cref(jobs), std::ref(results), std::cref(settings));
+    }
+    for (std::thread& worker : workers){
+        worker.join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::ofstream outFile;
+    if (outFilename){
+        outFile.open(outFilename);
+        if (!outFile.is_open()){
+            std::cerr << "Could not write " << outFilename << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream& out = outFilename ? outFile : std::cout;
+
+    uint64_t retired = 0;
+    bool failed = false;
+
+    out << "job,rom,script,frames,instructions,hash,halt\n";
+    for (size_t i = 0; i < jobs.size(); i++){
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)results[i].hash);
+
+        out << i << "," << Csv(jobs[i].rom) << "," << Csv(jobs[i].script) << "," << results[i].frames << ","
+            << results[i].instructions << "," << hash << "," << results[i].halt << "\n";
+        retired += results[i].instructions;
+        failed |= results[i].frames == 0 && jobs[i].frames > 0;
+    }
+
+    std::fprintf(stderr, "jobs=%zu threads=%u steals=%llu elapsed_s=%.6f ips=%.0f\n", jobs.size(), threads,
+                 (unsigned long long)queues.Steals(), elapsed, elapsed > 0 ? retired / elapsed : 0.0);
+    return failed ? EXIT_FAILURE : 0;
+}
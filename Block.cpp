@@ -0,0 +1,234 @@
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+//Superblock backend. Code is recorded into micro-ops the first time it runs, following the path
+//it actually took through jumps, calls and skips, so a hot loop usually becomes a single block.
+//A block replays with no fetch, decode or pc increment per instruction: only control ops set pc,
+//and the block is left early when one of them goes somewhere other than where it went while
+//recording. No code is generated at run time.
+
+const unsigned int MAX_BLOCK_LENGTH = 64;
+
+namespace {
+
+    using MicroOp = Chip8::BlockCache::MicroOp;
+
+    enum class Flow : uint8_t {
+        Next,       //Doesn't touch pc.
+        Branch,     //Jumps, calls, skips and Fx0A.
+        End         //Ends the block: 00EE and Bnnn go anywhere, Fx33 and Fx55 write memory.
+    };
+
+    //Same decoding as the function pointer tables, aliases included.
+    Flow Classify(uint16_t opcode){
+        switch (opcode >> 12u){
+            case 0x0: return (opcode & 0x000Fu) == 0xE ? Flow::End : Flow::Next;
+            case 0x1:
+            case 0x2:
+            case 0x3:
+            case 0x4:
+            case 0x5:
+            case 0x9:
+                return Flow::Branch;
+            case 0xB:
+                return Flow::End;
+            case 0xE:
+                return (opcode & 0x000Fu) == 0x1 || (opcode & 0x000Fu) == 0xE ? Flow::Branch : Flow::Next;
+            case 0xF:
+                switch (opcode & 0x00FFu){
+                    case 0x0A: return Flow::Branch;
+                    case 0x33:
+                    case 0x55:
+                        return Flow::End;
+                }
+                break;
+        }
+        return Flow::Next;
+    }
+}
+
+    //Runs instructions one at a time from pc, recording them as a block starting there. The
+    //block is only kept if it ends on its own, not because the budget ran out part way.
+    //Returns the number of instructions run, counting an Fx0A that blocked.
+    static uint64_t RecordBlock(Chip8::BlockCache& cache, Chip8& c, uint64_t budget){
+        Chip8::BlockCache::Block block{static_cast<uint32_t>(cache.ops.size()), 0, false, nullptr};
+        unsigned int start = c.PC();
+        bool visited[MEMORY_SIZE]{};
+        uint64_t executed = 0;
+
+        while (executed < budget){
+            //The block stops short of the end of memory, RunBlockTier() steps through there.
+            unsigned int address = c.PC();
+            bool keep = block.length == MAX_BLOCK_LENGTH || visited[address & (MEMORY_SIZE - 1)] || address + 2 >= MEMORY_SIZE;
+
+            if (keep && block.length > 0){
+                cache.blocks.push_back(block);
+                cache.lookup[start] = static_cast<uint16_t>(cache.blocks.size());
+                return executed;
+            }
+
+            uint16_t opcode = Chip8::Ops::Fetch(c, address);
+            Flow flow = Classify(opcode);
+            MicroOp micro{};
+
+            micro.op = Chip8::Ops::DecodeOpcode(opcode);
+            micro.opcode = opcode;
+            micro.pc = static_cast<uint16_t>(address + 2);
+            micro.next = micro.pc;
+            micro.control = flow != Flow::Next;
+            micro.end = flow == Flow::End;
+
+            visited[address & (MEMORY_SIZE - 1)] = true;
+            cache.covered[address & (MEMORY_SIZE - 1)] = 1;
+            cache.covered[(address + 1) & (MEMORY_SIZE - 1)] = 1;
+            cache.ops.push_back(micro);
+            block.length++;
+
+            //Committed before it runs: a write can flush the cache, this block included.
+            if (flow == Flow::End){
+                cache.blocks.push_back(block);
+                cache.lookup[start] = static_cast<uint16_t>(cache.blocks.size());
+                Chip8::Ops::RunMicroOp(c, micro);
+                return executed + 1;
+            }
+
+            Chip8::Ops::RunMicroOp(c, micro);
+
+            //A blocked Fx0A ends the block, replays leave it there too while no key is down.
+            if (Chip8::Ops::WaitingForKey(c)){
+                cache.blocks.push_back(block);
+                cache.lookup[start] = static_cast<uint16_t>(cache.blocks.size());
+                return executed + 1;
+            }
+
+            cache.ops.back().next = c.PC();
+            executed++;
+        }
+
+        cache.ops.resize(block.firstOp);
+        return executed;
+    }
+
+    void Chip8::Ops::RunMicroOp(Chip8& c, BlockCache::MicroOp const& micro){
+        c.pc = micro.pc;
+        micro.op.run(c, micro.op);
+    }
+
+    //Shared by the Blocks and Jit backends. With Jit, a block is compiled the first time it's
+    //replayed and runs natively whenever the budget covers all of it.
+    template <bool Jit>
+    uint64_t Chip8::Ops::RunBlockTier(Chip8& c, uint64_t count){
+        if (!c.blockCache){
+            c.blockCache.reset(new BlockCache());
+        }
+
+        BlockCache& cache = *c.blockCache;
+        uint64_t const budget = count;
+
+        while (count > 0 && !c.waitingForKey){
+            unsigned int address = c.pc;
+
+            //From the last instruction in memory on, fetches wrap to address 0 but pc doesn't.
+            //Blocks are only kept for pcs below that, where the address is the whole pc.
+            if (address >= MEMORY_SIZE - 2){
+                Decoded d = DecodeOpcode(Fetch(c, address));
+                c.pc = static_cast<uint16_t>(address + 2);
+                d.run(c, d);
+                count--;
+                continue;
+            }
+
+            uint16_t entry = cache.lookup[address];
+
+            if (entry == 0){
+                count -= RecordBlock(cache, c, count);
+                continue;
+            }
+
+            BlockCache::Block block = cache.blocks[entry - 1];
+
+            if (Jit && count >= block.length){
+                if (!block.compiled){
+                    block.native = CompileBlock(c, block);
+                    block.compiled = true;
+                    cache.blocks[entry - 1] = block;
+                }
+                if (block.native){
+                    count -= block.native(&c, count);
+                    continue;
+                }
+            }
+
+            MicroOp const* ops = &cache.ops[block.firstOp];
+            uint32_t generation = cache.generation;
+            bool again = true;
+
+            //A block that ends by jumping back to its own start runs again without a lookup.
+            while (again && count > 0){
+                //A budget ending mid-block runs a prefix of it.
+                unsigned int length = static_cast<unsigned int>(std::min<uint64_t>(block.length, count));
+                unsigned int executed = 0;
+                uint16_t next = c.pc;
+                bool left = false;
+
+                //next is copied out first: an op that writes memory can flush the cache it lives in.
+                while (executed < length){
+                    MicroOp const& micro = ops[executed++];
+                    next = micro.next;
+
+                    if (!micro.control){
+                        micro.op.run(c, micro.op);
+                        continue;
+                    }
+
+                    c.pc = micro.pc;
+                    micro.op.run(c, micro.op);
+
+                    if (c.pc != next){
+                        left = true;
+                        break;
+                    }
+                }
+
+                if (!left){
+                    c.pc = next;
+                }
+                count -= executed;
+                again = c.pc == address && executed == block.length && cache.generation == generation && !c.waitingForKey;
+            }
+        }
+
+        //Every path above counts a blocked Fx0A along with the rest.
+        return c.waitingForKey ? budget - count - 1 : budget - count;
+    }
+
+    uint64_t Chip8::Ops::RunBlocks(Chip8& c, uint64_t count){
+        return RunBlockTier<false>(c, count);
+    }
+
+    uint64_t Chip8::Ops::RunJit(Chip8& c, uint64_t count){
+        return RunBlockTier<true>(c, count);
+    }
+
+    //Flushes every block when the written range overlaps translated code. Self-modifying
+    //ROMs are rare enough that rebuilding beats tracking which blocks cover which bytes.
+    void Chip8::Ops::InvalidateBlocks(Chip8& c, unsigned int address, unsigned int length){
+        BlockCache& cache = *c.blockCache;
+        bool hit = false;
+
+        for (unsigned int i = 0; i < std::min(length, MEMORY_SIZE); i++){
+            hit |= cache.covered[(address + i) & (MEMORY_SIZE - 1)] != 0;
+        }
+
+        if (hit){
+            std::memset(cache.lookup, 0, sizeof(cache.lookup));
+            std::memset(cache.covered, 0, sizeof(cache.covered));
+            cache.blocks.clear();
+            cache.ops.clear();
+            cache.codeUsed = 0;
+            cache.generation++;
+        }
+    }
@@ -1,15 +1,18 @@
 #include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include "Expand.hpp"
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
-#include <random>
 
 
-const unsigned int START_ADDRESS = 0x200;
-const unsigned int FONTSET_START = 0x50;
 const unsigned int FONTSET_SIZE = 80;
 
+//How often Advance() looks for an idle loop or a blocked Fx0A, in instructions.
+const uint64_t IDLE_CHECK_INTERVAL = 256;
+
 uint8_t fontset[80] = {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 	    0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -29,125 +32,346 @@ uint8_t fontset[80] = {
 	    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
 
-    Chip8::Chip8() : randGen(std::chrono::system_clock::now().time_since_epoch().count())
+    //Built at compile time, so constructing a Chip8 doesn't touch them.
+    struct Chip8::OpTables {
+        Chip8Func table[0xF + 1];
+        Chip8Func table0[0xF + 1];
+        Chip8Func table8[0xF + 1];
+        Chip8Func tableE[0xF + 1];
+        Chip8Func tableF[0xFF + 1];
+
+        constexpr OpTables() : table{}, table0{}, table8{}, tableE{}, tableF{} {
+            table[0x0] = &Chip8::Table0;
+            table[0x1] = &Chip8::OP_1nnn;
+            table[0x2] = &Chip8::OP_2nnn;
+            table[0x3] = &Chip8::OP_3xkk;
+            table[0x4] = &Chip8::OP_4xkk;
+            table[0x5] = &Chip8::OP_5xy0;
+            table[0x6] = &Chip8::OP_6xkk;
+            table[0x7] = &Chip8::OP_7xkk;
+            table[0x8] = &Chip8::Table8;
+            table[0x9] = &Chip8::OP_9xy0;
+            table[0xA] = &Chip8::OP_Annn;
+            table[0xB] = &Chip8::OP_Bnnn;
+            table[0xC] = &Chip8::OP_Cxkk;
+            table[0xD] = &Chip8::OP_Dxyn;
+            table[0xE] = &Chip8::TableE;
+            table[0xF] = &Chip8::TableF;
+
+            for (size_t i = 0; i <= 0xF; i++){
+                table0[i] = &Chip8::OP_NULL;
+                table8[i] = &Chip8::OP_NULL;
+                tableE[i] = &Chip8::OP_NULL;
+            }
+
+            table0[0x0] = &Chip8::OP_00E0;
+            table0[0xE] = &Chip8::OP_00EE;
+
+            table8[0x0] = &Chip8::OP_8xy0;
+            table8[0x1] = &Chip8::OP_8xy1;
+            table8[0x2] = &Chip8::OP_8xy2;
+            table8[0x3] = &Chip8::OP_8xy3;
+            table8[0x4] = &Chip8::OP_8xy4;
+            table8[0x5] = &Chip8::OP_8xy5;
+            table8[0x6] = &Chip8::OP_8xy6;
+            table8[0x7] = &Chip8::OP_8xy7;
+            table8[0xE] = &Chip8::OP_8xyE;
+
+            tableE[0x1] = &Chip8::OP_ExA1;
+            tableE[0xE] = &Chip8::OP_Ex9E;
+
+            for (size_t i = 0; i <= 0xFF; i++){
+                tableF[i] = &Chip8::OP_NULL;
+            }
+
+            tableF[0x07] = &Chip8::OP_Fx07;
+            tableF[0x0A] = &Chip8::OP_Fx0A;
+            tableF[0x15] = &Chip8::OP_Fx15;
+            tableF[0x18] = &Chip8::OP_Fx18;
+            tableF[0x1E] = &Chip8::OP_Fx1E;
+            tableF[0x29] = &Chip8::OP_Fx29;
+            tableF[0x33] = &Chip8::OP_Fx33;
+            tableF[0x55] = &Chip8::OP_Fx55;
+            tableF[0x65] = &Chip8::OP_Fx65;
+        }
+    };
+
+    Chip8::OpTables const Chip8::opTables;
+
+    //Tens of thousands of instances can share a process, and a fork costs one instance until it
+    //writes to memory, keep each one small.
+    static_assert(sizeof(Chip8) <= 640, "Chip8 instance grew past 640 bytes");
+
+    Chip8::Chip8() : Chip8(static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count()))
+    {
+    }
+
+    //Memory nothing has written to yet. Every instance starts out on it, so constructing one
+    //allocates nothing until the first write, which copies the page like for a fork. Its count
+    //is never changed, it stays shared and is never freed.
+    static Chip8::Page zeroPage{{}, {UINT32_MAX}};
+
+    //Fixed seed so headless runs are reproducible.
+    Chip8::Chip8(uint32_t seed)
+    {
+        for (Page*& page : pages){
+            page = &zeroPage;
+        }
+
+        PowerOn(seed);
+        SetDispatch(Dispatch::CHIP8_DEFAULT_DISPATCH);
+    }
+
+    //Fork()'s copy: everything a program can observe, with the memory pages shared instead of
+    //copied. The backends' caches start out empty.
+    Chip8::Chip8(Chip8 const& parent)
+        : pc(parent.pc), index(parent.index), opcode(parent.opcode), sp(parent.sp),
+          delaySet(parent.delaySet), soundSet(parent.soundSet), dispatch(parent.dispatch),
+          drawFlag(parent.drawFlag), waitingForKey(parent.waitingForKey), idleSkip(parent.idleSkip),
+          ticks(parent.ticks), delayTick(parent.delayTick), soundTick(parent.soundTick),
+          frameCycles(parent.frameCycles), dirtyFirst(parent.dirtyFirst), dirtyLast(parent.dirtyLast),
+          quirks(parent.quirks), randState(parent.randState), aot(parent.aot)
     {
+        std::copy(parent.registers, parent.registers + REGISTER_COUNT, registers);
+        std::copy(parent.keypad, parent.keypad + KEY_COUNT, keypad);
+        std::copy(parent.video, parent.video + VIDEO_HEIGHT, video);
+        std::copy(parent.stack, parent.stack + STACK_LEVELS, stack);
+
+        for (unsigned int i = 0; i < MEMORY_PAGES; i++){
+            pages[i] = parent.pages[i];
+            if (pages[i] != &zeroPage){
+                pages[i]->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    static void ReleasePage(Chip8::Page* page){
+        if (page != &zeroPage && page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            delete page;
+        }
+    }
+
+    Chip8::~Chip8(){
+        for (Page* page : pages){
+            ReleasePage(page);
+        }
+    }
+
+    //A new machine in the same state, for searching over inputs: the child runs on its own from
+    //here and neither sees what the other does. Costs sizeof(Chip8) until one of them writes to
+    //memory, when the page written to is copied. The backends' caches are rebuilt per instance,
+    //so children that only run briefly are best on the interpreters, e.g. Tables or Switch.
+    std::unique_ptr<Chip8> Chip8::Fork() const{
+        return std::unique_ptr<Chip8>(new Chip8(*this));
+    }
+
+    //Bytes this instance accounts for: itself and its share of each memory page, so summing over
+    //a parent and its forks counts every page once. Pages never written to cost nothing, and the
+    //backends' caches aren't counted.
+    size_t Chip8::Footprint() const{
+        size_t bytes = sizeof(*this);
+
+        for (Page const* page : pages){
+            if (page != &zeroPage){
+                bytes += sizeof(Page) / page->refs.load(std::memory_order_relaxed);
+            }
+        }
+        return bytes;
+    }
+
+    //Gives c its own copy of a page it shares with a fork, or of the zero page.
+    Chip8::Page* Chip8::Ops::Unshare(Chip8& c, unsigned int page){
+        Page* shared = c.pages[page];
+        Page* own = new Page();
+
+        std::copy(shared->bytes, shared->bytes + MEMORY_PAGE_SIZE, own->bytes);
+        ReleasePage(shared);
+        c.pages[page] = own;
+        c.fetchBase = UINT16_MAX;
+        return own;
+    }
+
+    //Puts the machine back the way Chip8(seed) starts it, so one instance can run job after job.
+    //The dispatch backend, quirks and idle skip setting stay, and so do the caches' allocations.
+    void Chip8::Reset(uint32_t seed){
+        std::memset(registers, 0, sizeof(registers));
+        for (Page*& page : pages){
+            if (page->refs.load(std::memory_order_acquire) == 1){
+                std::memset(page->bytes, 0, sizeof(page->bytes));
+            }
+            else {
+                ReleasePage(page);
+                page = &zeroPage;
+            }
+        }
+        fetchBase = UINT16_MAX;
+        std::memset(stack, 0, sizeof(stack));
+        std::memset(keypad, 0, sizeof(keypad));
+        std::memset(video, 0, sizeof(video));
+        index = 0;
+        opcode = 0;
+        sp = 0;
+        delaySet = 0;
+        soundSet = 0;
+        ticks = 0;
+        delayTick = 0;
+        soundTick = 0;
+        frameCycles = 0;
+        drawFlag = false;
+        waitingForKey = false;
+        dirtyFirst = 0;
+        dirtyLast = VIDEO_HEIGHT - 1;
+        aot = nullptr;
+
+        Ops::CodeWritten(*this, 0, MEMORY_SIZE);
+        PowerOn(seed);
+    }
+
+    //What both the constructor and Reset() do to an all-zero machine.
+    void Chip8::PowerOn(uint32_t seed){
         //Things here need to happen first.
         pc = START_ADDRESS;
 
         
         //Load fontset into memory.
         for (unsigned int i = 0; i < 80; i++){
-            memory[FONTSET_START + i] = fontset[i];
+            Ops::Write(*this, FONTSET_START + i) = fontset[i];
         }
 
-        //Seed RNG
-    randByte = std::uniform_int_distribution<uint8_t>(0, 255U);
-        //Function pointer tables
-        table[0x0] = &Chip8::Table0;
-		table[0x1] = &Chip8::OP_1nnn;
-		table[0x2] = &Chip8::OP_2nnn;
-		table[0x3] = &Chip8::OP_3xkk;
-		table[0x4] = &Chip8::OP_4xkk;
-		table[0x5] = &Chip8::OP_5xy0;
-		table[0x6] = &Chip8::OP_6xkk;
-		table[0x7] = &Chip8::OP_7xkk;
-		table[0x8] = &Chip8::Table8;
-		table[0x9] = &Chip8::OP_9xy0;
-		table[0xA] = &Chip8::OP_Annn;
-		table[0xB] = &Chip8::OP_Bnnn;
-		table[0xC] = &Chip8::OP_Cxkk;
-		table[0xD] = &Chip8::OP_Dxyn;
-		table[0xE] = &Chip8::TableE;
-		table[0xF] = &Chip8::TableF;
-
-		for (size_t i = 0; i <= 0xE; i++)
-		{
-			table0[i] = &Chip8::OP_NULL;
-			table8[i] = &Chip8::OP_NULL;
-			tableE[i] = &Chip8::OP_NULL;
-		}
-
-		table0[0x0] = &Chip8::OP_00E0;
-		table0[0xE] = &Chip8::OP_00EE;
-
-		table8[0x0] = &Chip8::OP_8xy0;
-		table8[0x1] = &Chip8::OP_8xy1;
-		table8[0x2] = &Chip8::OP_8xy2;
-		table8[0x3] = &Chip8::OP_8xy3;
-		table8[0x4] = &Chip8::OP_8xy4;
-		table8[0x5] = &Chip8::OP_8xy5;
-		table8[0x6] = &Chip8::OP_8xy6;
-		table8[0x7] = &Chip8::OP_8xy7;
-		table8[0xE] = &Chip8::OP_8xyE;
-
-		tableE[0x1] = &Chip8::OP_ExA1;
-		tableE[0xE] = &Chip8::OP_Ex9E;
-
-		for (size_t i = 0; i <= 0x65; i++)
-		{
-			tableF[i] = &Chip8::OP_NULL;
-		}
-
-		tableF[0x07] = &Chip8::OP_Fx07;
-		tableF[0x0A] = &Chip8::OP_Fx0A;
-		tableF[0x15] = &Chip8::OP_Fx15;
-		tableF[0x18] = &Chip8::OP_Fx18;
-		tableF[0x1E] = &Chip8::OP_Fx1E;
-		tableF[0x29] = &Chip8::OP_Fx29;
-		tableF[0x33] = &Chip8::OP_Fx33;
-		tableF[0x55] = &Chip8::OP_Fx55;
-		tableF[0x65] = &Chip8::OP_Fx65;
-    
+        //Seed RNG, the same way std::minstd_rand0 does.
+        randState = seed % MINSTD_MODULUS;
+        if (randState == 0){
+            randState = 1;
+        }
     }
 
-     void Chip8::LoadROM(char const* filename){
+     bool Chip8::LoadROM(char const* filename){
 
         //Open a file as a stream, file pointer goes to end.
         std::ifstream file(filename, std::ios::binary | std::ios::ate);
 
-        if(file.is_open()){
-            std::streampos size= file.tellg();
-            char* buffer = new char[size];
+        if(!file.is_open()){
+            return false;
+        }
+
+        std::streampos size= file.tellg();
+
+        //ROM has to fit between START_ADDRESS and the end of memory.
+        if (size < 0 || size > static_cast<std::streampos>(MEMORY_SIZE - START_ADDRESS)){
+            return false;
+        }
+
+        char* buffer = new char[size];
+
+        //Go back to the beginning of the file, fill buffer.
+        file.seekg(0,std::ios::beg);
+        file.read(buffer,size);
+        file.close();
+
+        bool loaded = LoadROM(reinterpret_cast<uint8_t const*>(buffer), static_cast<size_t>(size));
+        delete[] buffer;
+        return loaded;
+    }
+
+    //Same as loading a file holding size bytes of data.
+    bool Chip8::LoadROM(uint8_t const* data, size_t size){
+        if (size > MEMORY_SIZE - START_ADDRESS){
+            return false;
+        }
+
+        //Load ROM into memory.
+        for (size_t i = 0; i < size; i++){
+            Ops::Write(*this, START_ADDRESS + static_cast<unsigned int>(i)) = data[i];
+        }
+        Ops::CodeWritten(*this, START_ADDRESS, static_cast<unsigned int>(size));
+        aot = Ops::FindAot(data, size);
+        return true;
+    }
 
-            //Go back to the beginning of the file, fill buffer.
-            file.seekg(0,std::ios::beg);
-            file.read(buffer,size);
-            file.close();
+    //FNV-1a over the display, used to compare frames between runs.
+    uint64_t Chip8::FrameHash() const{
+        uint64_t hash = 0xCBF29CE484222325ull;
+        uint8_t const* bytes = reinterpret_cast<uint8_t const*>(video);
 
-            //Load ROM into memory.
-            for (long i = 0; i < size; i++){
-                memory[START_ADDRESS + i] = buffer[i];
+        for (size_t i = 0; i < sizeof(video); i++){
+            hash ^= bytes[i];
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    //FNV-1a over everything a program can observe: registers, memory, timers, stack and display.
+    uint64_t Chip8::StateHash() const{
+        uint64_t hash = 0xCBF29CE484222325ull;
+        auto mix = [&hash](void const* data, size_t size){
+            uint8_t const* bytes = static_cast<uint8_t const*>(data);
+            for (size_t i = 0; i < size; i++){
+                hash ^= bytes[i];
+                hash *= 0x100000001B3ull;
             }
+        };
 
-            delete[] buffer;
+        mix(registers, sizeof(registers));
+        for (Page const* page : pages){
+            mix(page->bytes, sizeof(page->bytes));
         }
+        mix(&index, sizeof(index));
+        mix(&pc, sizeof(pc));
+        mix(stack, sizeof(stack));
+        mix(&sp, sizeof(sp));
+        uint8_t timers[2] = {DelayTimer(), SoundTimer()};
+        mix(timers, sizeof(timers));
+        mix(video, sizeof(video));
+        return hash;
+    }
+
+    void Chip8::SetQuirks(Quirks newQuirks){
+        quirks = newQuirks;
     }
 
-    //Instructions for Chip-8 begin here.
+    //Only 00E0 and Dxyn change the display. A new Chip8 starts dirty so its first frame is shown.
+    void Chip8::MarkDirty(unsigned int first, unsigned int last){
+        dirtyFirst = std::min<unsigned int>(dirtyFirst, first);
+        dirtyLast = std::max<unsigned int>(dirtyLast, last);
+    }
+
+    uint16_t Chip8::InstructionAt(unsigned int address) const{
+        return Ops::Fetch(*this, address);
+    }
+
+    //Called by the frontend once it has presented the dirty rows.
+    void Chip8::ClearDirty(){
+        dirtyFirst = VIDEO_HEIGHT;
+        dirtyLast = 0;
+    }
+
+    //Converts the bitplane to 0xFFFFFFFF/0x00000000 pixels for presenting or exporting.
+    void Chip8::ExpandToRGBA(uint32_t* pixels) const{
+        ExpandBitplanes(video, nullptr, VIDEO_WIDTH, VIDEO_HEIGHT, Palette{}, PixelFormat::RGBA8888, 1, pixels, VIDEO_WIDTH * sizeof(uint32_t));
+    }
+
+    //Instructions for Chip-8 begin here. What each one does lives in Chip8::Ops, shared with the other dispatch backends.
 
     //Clear display (CLS)
     void Chip8::OP_00E0(){
-        memset(video, 0, sizeof(video));
+        Ops::Cls(*this);
     }
 
     //Return from a subroutine(RET)
     void Chip8::OP_00EE(){
-         sp--;
-         pc = stack[sp];
+        Ops::Ret(*this);
     }
 
     //Jump to a location (nnn)
     void Chip8::OP_1nnn(){
         uint16_t address = opcode & 0x0FFFu;
-        pc = address;
+        Ops::Jump(*this, address);
     }
 
     //Call subroutine at nnn
     void Chip8::OP_2nnn(){
         uint16_t address = opcode & 0x0FFFu;
-        stack[sp] = pc;
-        sp++;
-        pc = address;
+        Ops::Call(*this, address);
     }
 
     //Skip next instruction if Vx == kk
@@ -155,9 +379,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t byte = opcode & 0x0FFu;
 
-        if(registers[Vx] == byte){
-            pc += 2;
-        }
+        Ops::SkipIfEqual(*this, Vx, byte);
     }
 
     //Skip next instruction if Vx != kk
@@ -165,9 +387,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode &0x0F00u) >> 8u;
         uint8_t byte = opcode & 0x00FFu;
 
-        if(registers[Vx] != byte){
-            pc += 2;
-        }
+        Ops::SkipIfNotEqual(*this, Vx, byte);
     }
 
     //Skip next instruction if Vx == Vy
@@ -175,9 +395,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        if(registers[Vx] == registers[Vy]){
-            pc += 2;
-        }
+        Ops::SkipIfRegistersEqual(*this, Vx, Vy);
     }
 
     //Set Vx to kk
@@ -185,7 +403,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t byte = opcode & 0x00FFu;
 
-        registers[Vx] = byte;
+        Ops::Set(*this, Vx, byte);
     }
 
     //Add Vx and kk values
@@ -194,7 +412,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t byte = opcode & 0x00FFu;
 
-        registers[Vx] += byte;
+        Ops::AddImmediate(*this, Vx, byte);
     }
 
     //Sets Vx to Vy
@@ -202,7 +420,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        registers[Vx] = registers[Vy];
+        Ops::Move(*this, Vx, Vy);
     }
 
     //Set Vx or Vy
@@ -210,7 +428,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        registers[Vx] |= registers[Vy];
+        Ops::Or(*this, Vx, Vy);
     }
 
     //Set Vx to Vx AND Vy
@@ -218,7 +436,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        registers[Vx] &= registers[Vy];
+        Ops::And(*this, Vx, Vy);
     }
 
     //Set VX = Vx XOR Vy
@@ -226,23 +444,15 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        registers[Vx] ^= registers[Vy];
+        Ops::Xor(*this, Vx, Vy);
     }
 
     //Add Vx and Vy, with carry value Vf
     void Chip8::OP_8xy4(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-        uint16_t sum = registers[Vx] + registers[Vy];
-
-        if (sum > 255U){
-            registers[0xF] = 1;
-        }
-        else{
-            registers[0xF] = 0;
-        }
 
-        registers[Vx] = sum & 0xFFu;    
+        Ops::Add(*this, Vx, Vy);
     }
 
     //Subtract Vx and Vy, Vf set to not borrow.
@@ -250,21 +460,13 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        if(registers[Vx] > registers[Vy]) {
-            registers[0xF] = 1;
-        }
-        else {
-            registers[0xF] = 0;
-        }
-
-        registers[Vx] -= registers[Vy];
+        Ops::Sub(*this, Vx, Vy);
     }
 
     //If the least sig bit of Vx is 1, Vf gets set to 1. Vx is divided by 2 (right shift).
     void Chip8::OP_8xy6(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        registers[0xF] = (registers[Vx] & 0x1u);
-        registers[Vx] >>= 1;
+        Ops::ShiftRight(*this, Vx);
     }
 
     //Subtract Vy and Vx, Vf set to not borrow
@@ -272,21 +474,13 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        if(registers[Vy] > registers[Vx]){
-            registers[0xF] = 1;
-        }
-        else{
-            registers[0xF] = 0;
-        }
-
-        registers[Vx] = registers[Vy] - registers[Vx];
+        Ops::SubReverse(*this, Vx, Vy);
     }
 
     //If the most sig bit of Vx is 1 then Vf is set to 1. Then Vx is multiplied by 2 (left shift)
     void Chip8::OP_8xyE(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        registers[0xF] = (registers[Vx] & 0x80u) >> 7u;
-        registers[Vx] <<= 1;
+        Ops::ShiftLeft(*this, Vx);
     }
 
     //Skip next instruction if Vx != Vy.
@@ -295,23 +489,21 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
 
-        if(registers[Vx] != registers[Vy]) {
-            pc += 2;
-        }
+        Ops::SkipIfRegistersNotEqual(*this, Vx, Vy);
     }
 
     //Sets index to address(nnn)
     void Chip8::OP_Annn(){
         uint16_t address = opcode & 0x0FFFu;
 
-        index = address;
+        Ops::SetIndex(*this, address);
     }
 
     //Jumps to Location nnn + V0
     void Chip8::OP_Bnnn(){
         uint16_t address = opcode & 0x0FFFu;
 
-        pc = registers[0] + address;
+        Ops::JumpOffset(*this, address);
     }
 
     //Sets Vx to randomByte and kk
@@ -319,7 +511,7 @@ uint8_t fontset[80] = {
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t byte = opcode & 0x00FFu;
 
-        registers[Vx] = randByte(randGen) & byte;
+        Ops::Random(*this, Vx, byte);
     }
 
     //Display n-byte sprite staritng at memory location I at (Vx,Vy), Vf tracks collision 
@@ -328,218 +520,278 @@ uint8_t fontset[80] = {
         uint8_t Vy = (opcode & 0x00F0u) >> 4u;
         uint8_t height = opcode & 0x000Fu;
 
-        //Screen wrap
-        uint8_t xPos = registers[Vx] % VIDEO_WIDTH;
-        uint8_t yPos = registers[Vy] % VIDEO_HEIGHT;
-
-        registers[0xF] = 0;
-
-        for (unsigned int row = 0; row < height; row++){
-            uint8_t spriteByte = memory[index + row];
-
-            for (unsigned int col = 0; col < 8; col++){
-                uint8_t spritePixel = spriteByte & (0x80u >> col);
-                uint32_t* screenPixel = &video[(yPos + row) * 64 + (xPos + col)];
-
-                //Sprite Pixel is on
-
-                if(spritePixel){
-                    //Screen pixel also on.
-                    if (*screenPixel == 0xFFFFFFFF){
-                        registers[0xF] = 1;
-                    }
-                    *screenPixel ^= 0xFFFFFFFF;
-                }
-            }
-        }
+        Ops::Draw(*this, Vx, Vy, height);
     }
 
     //Skip next instruction if key with value of Vx is pressed
     void Chip8::OP_Ex9E(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        uint8_t key = registers[Vx];
-
-        if(keypad[key]){
-            pc += 2;
-        }
+        Ops::SkipIfKey(*this, Vx);
     }
 
     //Skip next instruction if key with value of Vx is not pressed
     void Chip8::OP_ExA1(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        uint8_t key = registers[Vx];
-
-        if(!keypad[key]){
-            pc += 2;
-        }
+        Ops::SkipIfNotKey(*this, Vx);
     }
 
     //Set Vx to the value of the delay timer
     void Chip8::OP_Fx07(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        
-        registers[Vx] = delayTimer;
+        Ops::GetDelay(*this, Vx);
     }
 
     //Wait for a keypress, store pressed key in Vx
     void Chip8::OP_Fx0A(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        
-        if(keypad[0]){
-            registers[Vx] = 0;
-        }
-        else if (keypad[1]){
-            registers[Vx] = 1;
-        }
-        else if (keypad[2]){
-            registers[Vx] = 2;
-        }
-        else if (keypad[3]){
-            registers[Vx] = 3;
-        }
-        else if (keypad[4]){
-            registers[Vx] = 4;
-        }
-        else if (keypad[5]){
-            registers[Vx] = 5;
-        }
-        else if (keypad[6]){
-            registers[Vx] = 6;
-        }
-        else if (keypad[7]){
-            registers[Vx] = 7;
-        }
-        else if (keypad[8]){
-            registers[Vx] = 8;
-        }
-        else if (keypad[9]){
-            registers[Vx] = 9;
-        }
-        else if (keypad[10]){
-            registers[Vx] = 10;
-        }
-        else if (keypad[11]){
-            registers[Vx] = 11;
-        }
-        else if (keypad[12]){
-            registers[Vx] = 12;
-        }
-        else if (keypad[13]){
-            registers[Vx] = 13;
-        }
-        else if (keypad[14]){
-            registers[Vx] = 14;
-        }
-        else if (keypad[15]){
-            registers[Vx] = 15;
-        }
-        else {
-            pc -= 2;
-        }
+        Ops::WaitKey(*this, Vx);
     }
     
     //Set delayTimer to Vx
     void Chip8::OP_Fx15(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-        delayTimer = registers[Vx];
+        Ops::SetDelay(*this, Vx);
     }
 
     //Set soundTimer to Vx
     void Chip8::OP_Fx18(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-        soundTimer = registers[Vx];
+        Ops::SetSound(*this, Vx);
     }
 
     //Set index to index + Vx
     void Chip8::OP_Fx1E(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-        index += registers[Vx];
+        Ops::AddIndex(*this, Vx);
     }
 
     //Index is set to the location of sprite for digit Vx
     void Chip8::OP_Fx29(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        uint8_t digit = registers[Vx];
-
-        index = FONTSET_START + (5 * digit);
+        Ops::FontCharacter(*this, Vx);
     }
 
     //Store BCD rep of Vx in memory locations I, I + 1, I + 2
     void Chip8::OP_Fx33(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-        uint8_t value = registers[Vx];
-
-        //Ones
-        memory[index + 2] = value % 10;
-        value /= 10;
-
-        //Tens
-        memory[index + 1] = value % 10;
-        value /= 10;
-
-        //Hundreds
-        memory[index] = value % 10;
+        Ops::Bcd(*this, Vx);
     }
 
     //Store registers V0 through Vx in memory at location I
     void Chip8::OP_Fx55(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-        for(uint8_t i = 0; i <= Vx; i++){
-            memory[index + i] = registers[i];
-        }
+        Ops::Store(*this, Vx);
     }
 
     //Read registers V0 through Vx in memory at location I
     void Chip8::OP_Fx65(){
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-
-        for(uint8_t i = 0; i <= Vx; i++){
-            registers[i] = memory[index + i];
-        }
+        Ops::Load(*this, Vx);
     }
 
      // Opcode Tables
     void Chip8::Table0(){
-		((*this).*(table0[opcode & 0x000Fu]))();
+		((*this).*(opTables.table0[opcode & 0x000Fu]))();
 	}
 
 	void Chip8::Table8(){
-		((*this).*(table8[opcode & 0x000Fu]))();
+		((*this).*(opTables.table8[opcode & 0x000Fu]))();
 	}
 
 	void Chip8::TableE(){
-		((*this).*(tableE[opcode & 0x000Fu]))();
+		((*this).*(opTables.tableE[opcode & 0x000Fu]))();
 	}
 
 	void Chip8::TableF(){
-		((*this).*(tableF[opcode & 0x00FFu]))();
+		((*this).*(opTables.tableF[opcode & 0x00FFu]))();
 	}
 
 	void Chip8::OP_NULL(){}
 
 
+
     //Fetch, Decode, Execute
-    void Chip8::Cycle(){
+    inline void Chip8::Step(){
         //Fetch
-        opcode = (memory[pc] << 8u) | memory[pc + 1];
+        opcode = Ops::Fetch(*this, pc);
 
         //Increment
         pc += 2;
 
         //Decode, Execute
-        ((*this).*(table[(opcode & 0xF000u) >> 12u]))();
+        ((*this).*(opTables.table[(opcode & 0xF000u) >> 12u]))();
+    }
+
+    //The original two-level member function pointer tables.
+    uint64_t Chip8::Ops::RunTables(Chip8& c, uint64_t count){
+        for (uint64_t i = 0; i < count; i++){
+            c.Step();
 
-        //Deal with delayTimer
-        if (delayTimer > 0){
-            --delayTimer;
+            if (c.waitingForKey){
+                return i;
+            }
+        }
+        return count;
+    }
+
+    //Timers count down at 60 Hz of emulated time, once per frame. See DelayTimer().
+    void Chip8::TickTimers(){
+        ticks++;
+    }
+
+    //Falls back to the tables for anything this build can't run.
+    Dispatch Chip8::SetDispatch(Dispatch newDispatch){
+        switch (newDispatch){
+            case Dispatch::Tables:
+            case Dispatch::DecodeTable:
+            case Dispatch::Switch:
+            case Dispatch::Predecoded:
+            case Dispatch::Blocks:
+            case Dispatch::Aot:
+#ifdef CHIP8_COMPUTED_GOTO
+            case Dispatch::Threaded:
+#endif
+#ifdef CHIP8_MUSTTAIL
+            case Dispatch::TailCall:
+#endif
+#ifdef CHIP8_JIT
+            case Dispatch::Jit:
+#endif
+                dispatch = newDispatch;
+                break;
+            default:
+                dispatch = Dispatch::Tables;
+                break;
+        }
+        return dispatch;
+    }
+
+    char const* DispatchName(Dispatch dispatch){
+        switch (dispatch){
+            case Dispatch::Tables: return "tables";
+            case Dispatch::DecodeTable: return "decode-table";
+            case Dispatch::Switch: return "switch";
+            case Dispatch::Threaded: return "threaded";
+            case Dispatch::TailCall: return "tail-call";
+            case Dispatch::Predecoded: return "predecoded";
+            case Dispatch::Blocks: return "blocks";
+            case Dispatch::Jit: return "jit";
+            case Dispatch::Aot: return "aot";
+        }
+        return "unknown";
+    }
+
+    bool ParseDispatch(char const* name, Dispatch& dispatch){
+        for (Dispatch candidate : ALL_DISPATCHES){
+            if (std::strcmp(name, DispatchName(candidate)) == 0){
+                dispatch = candidate;
+                return true;
+            }
         }
+        return false;
+    }
+
+    //Tight loop used by the Run* entry points, no clock reads or callbacks per instruction.
+    //Returns how many instructions ran, fewer than count if Fx0A blocked.
+    uint64_t Chip8::Execute(uint64_t count){
+        waitingForKey = false;
+
+        switch (dispatch){
+            case Dispatch::DecodeTable:
+                return Ops::RunDecodeTable(*this, count);
+            case Dispatch::Switch:
+                return Ops::RunSwitch(*this, count);
+            case Dispatch::Threaded:
+                return Ops::RunThreaded(*this, count);
+            case Dispatch::TailCall:
+                return Ops::RunTailCall(*this, count);
+            case Dispatch::Predecoded:
+                return Ops::RunPredecoded(*this, count);
+            case Dispatch::Blocks:
+                return Ops::RunBlocks(*this, count);
+            case Dispatch::Jit:
+                return Ops::RunJit(*this, count);
+            case Dispatch::Aot:
+                return Ops::RunAot(*this, count);
+            default:
+                return Ops::RunTables(*this, count);
+        }
+    }
+
+    bool Chip8::AnyKeyDown() const{
+        for (unsigned int key = 0; key < KEY_COUNT; key++){
+            if (keypad[key]){
+                return true;
+            }
+        }
+        return false;
+    }
 
-        //Deal with soundTimer
-        if (soundTimer > 0) {
-            --soundTimer;
+    //Runs up to count instructions, in chunks so an idle loop is noticed soon after it's entered
+    //and the rest fast-forwarded. Stops once Fx0A blocks: the keypad can't change before this
+    //returns, so neither can anything else.
+    void Chip8::Advance(uint64_t count, RunStats& stats){
+        uint64_t executed = 0;
+
+        while (count > 0){
+            if (waitingForKey){
+                if (!AnyKeyDown()){
+                    stats.idle = Idle::WaitKey;
+                    break;
+                }
+                waitingForKey = false;
+            }
+
+            if (idleSkip){
+                Idle idle = Ops::SkipIdle(*this, count);
+
+                if (idle != Idle::None){
+                    stats.skipped += count;
+                    stats.idle = idle;
+                    executed += count;
+                    break;
+                }
+            }
+
+            uint64_t ran = Execute(std::min(count, IDLE_CHECK_INTERVAL));
+            count -= ran;
+            executed += ran;
         }
-    }
\ No newline at end of file
+
+        stats.instructions += executed;
+    }
+
+    //Runs one instruction and returns 1, or 0 if the program is blocked in Fx0A.
+    uint64_t Chip8::Cycle(){
+        uint64_t ran = Execute(1);
+        frameCycles += ran;
+        return ran;
+    }
+
+    //Runs count instructions, fewer if the program blocks in Fx0A.
+    RunStats Chip8::RunCycles(uint64_t count){
+        RunStats stats;
+        drawFlag = false;
+
+        Advance(count, stats);
+        frameCycles += stats.instructions;
+
+        stats.displayChanged = drawFlag;
+        return stats;
+    }
+
+    //Runs whatever is left of the current frame's instruction budget, then ends the frame and ticks the timers.
+    RunStats Chip8::RunUntilFrameEnd(uint64_t instructionsPerFrame){
+        RunStats stats;
+        drawFlag = false;
+
+        if (frameCycles < instructionsPerFrame){
+            Advance(instructionsPerFrame - frameCycles, stats);
+        }
+
+        TickTimers();
+        frameCycles = 0;
+        stats.frames = 1;
+        stats.displayChanged = drawFlag;
+        return stats;
+    }
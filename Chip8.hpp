@@ -1,50 +1,198 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <fstream>
+#include <memory>
 #include <chrono>
-#include <random>
     
     
 
 const unsigned int KEY_COUNT = 16;
 const unsigned int MEMORY_SIZE = 4096;
+//Memory is held, and shared between forks, a page at a time.
+const unsigned int MEMORY_PAGE_SIZE = 256;
+const unsigned int MEMORY_PAGES = MEMORY_SIZE / MEMORY_PAGE_SIZE;
 const unsigned int REGISTER_COUNT = 16;
 const unsigned int STACK_LEVELS = 16;
 const unsigned int VIDEO_HEIGHT = 32;
 const unsigned int VIDEO_WIDTH = 64;   
 
-class Chip8 {
+//What happens to sprite pixels that run past the right or bottom edge.
+enum class EdgeMode : uint8_t {
+    Clip,
+    Wrap
+};
+
+//Behaviours that differ between CHIP-8 interpreters and that ROMs depend on.
+struct Quirks {
+    EdgeMode horizontal = EdgeMode::Clip;
+    EdgeMode vertical = EdgeMode::Clip;
+};
+
+//Display rows changed since the last ClearDirty(), inclusive. Empty when first > last.
+struct DirtyRows {
+    unsigned int first;
+    unsigned int last;
+
+    bool Empty() const { return first > last; }
+};
+
+//How the core gets from one instruction to the next. All of them run the same instructions
+//and leave the machine in the same state.
+enum class Dispatch : uint8_t {
+    Tables,         //The original member function pointer tables.
+    DecodeTable,    //One handler per opcode word, specialized on its register operands.
+    Switch,         //Nested switch statements in one loop, every instruction inlined.
+    Threaded,       //Computed goto, each instruction jumps straight to the next. GCC/Clang only.
+    TailCall,       //Decode table handlers that tail-call the next one. Needs musttail support.
+    Predecoded,     //Per-address cache of decoded instructions, refilled when code is written.
+    Blocks,         //Basic blocks translated once and run without per-instruction dispatch.
+    Jit,            //Blocks compiled to x86-64. Linux x86-64 only.
+    Aot             //The loaded ROM's chip8-aot output if it was linked in, else the tables.
+};
+
+const Dispatch ALL_DISPATCHES[] = {Dispatch::Tables, Dispatch::DecodeTable, Dispatch::Switch, Dispatch::Threaded, Dispatch::TailCall, Dispatch::Predecoded, Dispatch::Blocks, Dispatch::Jit, Dispatch::Aot};
+
+//Default for new Chip8 instances, e.g. build with -DCHIP8_DEFAULT_DISPATCH=Threaded.
+#ifndef CHIP8_DEFAULT_DISPATCH
+#define CHIP8_DEFAULT_DISPATCH Tables
+#endif
+
+char const* DispatchName(Dispatch dispatch);
+bool ParseDispatch(char const* name, Dispatch& dispatch);
+
+class Chip8;
+
+//A ROM translated to C++ by chip8-aot. run executes up to budget instructions from pc and returns
+//how many it ran, stopping early at any address it has no code for.
+struct AotProgram {
+    char const* name;
+    uint8_t const* rom;
+    size_t size;
+    uint8_t const* code;        //One bit per memory byte the translation was made from.
+    uint64_t (*run)(Chip8& c, uint64_t budget);
+};
+
+//Called by the generated files at static initialization. Must be linked into the executable
+//itself, not pulled from libchip8.a, or nothing references them.
+bool RegisterAotProgram(AotProgram const* program);
+
+//Summary of a batch of instructions run by RunCycles/RunUntilFrameEnd/RunUntil.
+//Idle loops the Run* entry points fast-forward through instead of running: loops that only
+//touch registers, I and pc, and come back to the same state every time round.
+enum class Idle : uint8_t {
+    None,
+    Halted,         //Reads nothing that can change, e.g. 1nnn jumping to itself.
+    DelayWait,      //Waits for the delay timer, e.g. Fx07, 3x00, 1nnn.
+    KeyPoll,        //Waits for a key with Ex9E/ExA1.
+    WaitKey         //Blocked in Fx0A. Not run at all until a key is down, takes no instructions.
+};
+
+char const* IdleName(Idle idle);
+
+struct RunStats {
+    uint64_t instructions{};
+    uint64_t frames{};
+    bool displayChanged{};
+    uint64_t skipped{};     //Instructions fast-forwarded rather than run, included in instructions.
+    Idle idle{};            //The idle loop the batch ended in, if it was fast-forwarded or blocked.
+};
+
+//Aligned so the hot state at the front sits in one cache line.
+class alignas(64) Chip8 {
 
     //Various components of the Chip8 system.
     public:
         Chip8();
-        void LoadROM(char const* filename);
-        void Cycle();
+        explicit Chip8(uint32_t seed);
+        ~Chip8();
+        bool LoadROM(char const* filename);
+        bool LoadROM(uint8_t const* data, size_t size);
+        void Reset(uint32_t seed);
+        std::unique_ptr<Chip8> Fork() const;
+        size_t Footprint() const;
+        uint64_t Cycle();
+        RunStats RunCycles(uint64_t count);
+        RunStats RunUntilFrameEnd(uint64_t instructionsPerFrame);
+        template <typename Predicate>
+        RunStats RunUntil(Predicate stop, uint64_t limit = UINT64_MAX);
+        void TickTimers();
+        uint64_t FrameHash() const;
+        uint64_t StateHash() const;
+        void SetQuirks(Quirks newQuirks);
+        DirtyRows Dirty() const { return DirtyRows{dirtyFirst, dirtyLast}; }
+        void ClearDirty();
+        Dispatch SetDispatch(Dispatch newDispatch);
+        Dispatch GetDispatch() const { return dispatch; }
+        bool HasAot() const { return aot != nullptr; }
+        void SetIdleSkip(bool enabled) { idleSkip = enabled; }
 
-        uint8_t keypad[KEY_COUNT]{};
-        uint32_t video[VIDEO_WIDTH * VIDEO_HEIGHT]{};
+        uint16_t PC() const { return pc; }
+        uint16_t Index() const { return index; }
+        uint8_t Register(unsigned int i) const { return registers[i]; }
+        uint8_t DelayTimer() const { return TimerAt(delaySet, delayTick); }
+        uint8_t SoundTimer() const { return TimerAt(soundSet, soundTick); }
+        uint16_t InstructionAt(unsigned int address) const;
+
+        void ExpandToRGBA(uint32_t* pixels) const;
 
-    private: 
+        //Instruction semantics and dispatch loops, see Chip8Ops.hpp.
+        struct Ops;
+        struct Decoded;
+        struct BlockCache;
+        struct Page;
+
+    private:
+        //Hot state, touched by nearly every instruction: kept together in the first cache line.
         uint8_t registers[REGISTER_COUNT] {};
-        uint8_t memory[MEMORY_SIZE] {};
-        uint16_t index{};
         uint16_t pc{};
-        uint16_t stack[STACK_LEVELS]{};
+        uint16_t index{};
+        uint16_t opcode{};
         uint8_t sp{};
-        uint8_t delayTimer{};
-        uint8_t soundTimer{};
-        uint16_t opcode;
+        uint8_t delaySet{};
+        uint8_t soundSet{};
+        Dispatch dispatch{Dispatch::Tables};
+        bool drawFlag{};
+        bool waitingForKey{};
+        bool idleSkip{true};
+        //The page Ops::Fetch() last read, so straight-line code doesn't look it up every time.
+        mutable uint16_t fetchBase{UINT16_MAX};
+        mutable uint8_t const* fetchBytes{};
+        //The timers are only stored when set, with the tick they were set on, and worked out
+        //from ticks when read. TickTimers() just advances ticks.
+        uint64_t ticks{};
+        uint64_t delayTick{};
+        uint64_t soundTick{};
+        uint64_t frameCycles{};
 
-        std::default_random_engine randGen;
-        std::uniform_int_distribution<uint8_t> randByte;
-         //function pointer tables
+    public:
+        uint8_t keypad[KEY_COUNT]{};
+        //One bit per pixel, one row per word. Bit 63 is the leftmost pixel.
+        uint64_t video[VIDEO_HEIGHT]{};
+
+    private:
+        uint16_t stack[STACK_LEVELS]{};
+        uint8_t dirtyFirst{};
+        uint8_t dirtyLast{VIDEO_HEIGHT - 1};
+        Quirks quirks{};
+        //minstd_rand0 state, see Ops::RandomByte().
+        uint32_t randState{1};
+        AotProgram const* aot{};
+
+        //Indexed by address, allocated the first time the Predecoded backend runs.
+        std::unique_ptr<Decoded[]> predecoded;
+        //Allocated the first time the Blocks backend runs.
+        std::unique_ptr<BlockCache> blockCache;
+
+        //Memory, MEMORY_PAGE_SIZE bytes per page. Pages can be shared with forks and are
+        //copied by the first one to write to them, see Ops::Write().
+        Page* pages[MEMORY_PAGES]{};
+
+        //Function pointer tables, shared by every instance and filled in at compile time.
         typedef void (Chip8::*Chip8Func)();
-	    Chip8Func table[0xF + 1];
-	    Chip8Func table0[0xE + 1];
-	    Chip8Func table8[0xE + 1];
-	    Chip8Func tableE[0xE + 1];
-	    Chip8Func tableF[0x65 + 1];
+        struct OpTables;
+        static OpTables const opTables;
 
         void Table0();
 	    void Table8();
@@ -86,4 +234,36 @@ class Chip8 {
     	void OP_Fx33();
     	void OP_Fx55();
     	void OP_Fx65();
-};
\ No newline at end of file
+
+        uint8_t TimerAt(uint8_t value, uint64_t setTick) const {
+            uint64_t elapsed = ticks - setTick;
+            return elapsed < value ? static_cast<uint8_t>(value - elapsed) : 0;
+        }
+        Chip8(Chip8 const& parent);
+        void PowerOn(uint32_t seed);
+        void MarkDirty(unsigned int first, unsigned int last);
+        void Step();
+        uint64_t Execute(uint64_t count);
+        void Advance(uint64_t count, RunStats& stats);
+        bool AnyKeyDown() const;
+};
+
+    //Runs until stop(*this) returns true before an instruction, limit instructions have run,
+    //or the program blocks in Fx0A.
+    template <typename Predicate>
+    RunStats Chip8::RunUntil(Predicate stop, uint64_t limit){
+        RunStats stats;
+        drawFlag = false;
+
+        while (stats.instructions < limit && !stop(static_cast<Chip8 const&>(*this))){
+            if (Execute(1) == 0){
+                stats.idle = Idle::WaitKey;
+                break;
+            }
+            stats.instructions++;
+        }
+
+        frameCycles += stats.instructions;
+        stats.displayChanged = drawFlag;
+        return stats;
+    }
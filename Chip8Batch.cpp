@@ -0,0 +1,700 @@
+#include "Chip8Batch.hpp"
+#include "Chip8Ops.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+//The lane passes below are plain loops over the lane arrays, left to the vectorizer. GCC builds
+//each of them for AVX-512BW, AVX2 and baseline x86-64 and picks one for the CPU at load time.
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define BATCH_CLONES __attribute__((target_clones("arch=x86-64-v4", "avx2", "default")))
+#else
+#define BATCH_CLONES
+#endif
+
+//Lane arrays are padded to a multiple of this many lanes, one AVX-512 register of bytes.
+const size_t LANE_ALIGN = 64;
+
+//A step taken by fewer than 1 in this many lanes runs lane by lane instead of as a masked pass.
+const unsigned int SCALAR_FRACTION = 8;
+
+//End of a lane list.
+const uint32_t NO_LANE = UINT32_MAX;
+
+namespace {
+
+    //What a masked pass works on, pulled out of Chip8Batch so the passes can be cloned.
+    struct LaneArrays {
+        uint8_t* registers;
+        uint16_t* pc;
+        uint16_t* index;
+        uint8_t* delaySet;
+        uint8_t* soundSet;
+        uint32_t* delayTick;
+        uint32_t* soundTick;
+        uint16_t const* keys;
+        uint64_t* video;
+        uint32_t* remaining;
+        uint8_t const* mask;
+        size_t stride;
+        uint32_t ticks;
+    };
+
+    //Masks in the lanes with instructions left.
+    BATCH_CLONES
+    void MaskActive(uint32_t const* remaining, uint8_t* mask, size_t count){
+        for (size_t l = 0; l < count; l++){
+            mask[l] = remaining[l] != 0 ? 0xFF : 0;
+        }
+    }
+
+    //How many lanes have instructions left, and the lowest and highest address they're at.
+    struct Span {
+        size_t active;
+        unsigned int lowest;
+        unsigned int highest;
+    };
+
+    BATCH_CLONES
+    Span FindSpan(uint16_t const* pc, uint32_t const* remaining, size_t count){
+        uint32_t active = 0;
+        uint32_t lowest = MEMORY_SIZE;
+        uint32_t highest = 0;
+
+        //Finished lanes count as being past the end for lowest and at 0 for highest.
+        for (size_t l = 0; l < count; l++){
+            uint32_t running = remaining[l] != 0;
+            uint32_t address = pc[l] & (MEMORY_SIZE - 1);
+            uint32_t low = address | (running ^ 1u) * MEMORY_SIZE;
+            uint32_t high = address * running;
+
+            active += running;
+            lowest = low < lowest ? low : lowest;
+            highest = high > highest ? high : highest;
+        }
+        return Span{active, lowest, highest};
+    }
+
+    //The instructions RunMasked() does. The rest touch memory, the stack, the RNG or the
+    //display, or can block, and always go through StepLane().
+    bool Maskable(uint16_t opcode){
+        switch (opcode >> 12u){
+            case 0x0:
+                return (opcode & 0x000Fu) != 0xE;
+            case 0x2:
+            case 0xC:
+            case 0xD:
+                return false;
+            case 0xF:
+                switch (opcode & 0x00FFu){
+                    case 0x0A:
+                    case 0x33:
+                    case 0x55:
+                    case 0x65:
+                        return false;
+                }
+                break;
+        }
+        return true;
+    }
+
+    //One instruction on every masked lane, same semantics as Chip8::Ops. Operands are read
+    //again after Vf is written wherever Ops does, so 8xF5 and friends come out the same.
+    BATCH_CLONES
+    void RunMasked(LaneArrays const& a, uint16_t opcode){
+        size_t count = a.stride;
+        unsigned int x = (opcode & 0x0F00u) >> 8u;
+        unsigned int y = (opcode & 0x00F0u) >> 4u;
+        uint8_t kk = opcode & 0x00FFu;
+        uint16_t nnn = opcode & 0x0FFFu;
+        uint8_t const* mask = a.mask;
+        uint16_t* pc = a.pc;
+        uint8_t* vx = a.registers + x * count;
+        uint8_t* vy = a.registers + y * count;
+        uint8_t* v0 = a.registers;
+        uint8_t* vf = a.registers + 0xF * count;
+        //Copied out: stores through the byte arrays could alias the struct.
+        uint16_t* index = a.index;
+        uint8_t* delaySet = a.delaySet;
+        uint8_t* soundSet = a.soundSet;
+        uint32_t* delayTick = a.delayTick;
+        uint32_t* soundTick = a.soundTick;
+        uint16_t const* keys = a.keys;
+        uint32_t* remaining = a.remaining;
+        uint32_t ticks = a.ticks;
+
+        for (size_t l = 0; l < count; l++){
+            pc[l] += mask[l] & 2u;
+            remaining[l] -= mask[l] & 1u;
+        }
+
+        switch (opcode >> 12u){
+            case 0x0:
+                if ((opcode & 0x000Fu) == 0x0){
+                    for (unsigned int row = 0; row < VIDEO_HEIGHT; row++){
+                        uint64_t* video = a.video + row * count;
+                        for (size_t l = 0; l < count; l++){
+                            video[l] = mask[l] ? 0 : video[l];
+                        }
+                    }
+                }
+                break;
+            case 0x1:
+                for (size_t l = 0; l < count; l++){
+                    pc[l] = mask[l] ? nnn : pc[l];
+                }
+                break;
+            case 0x3:
+                for (size_t l = 0; l < count; l++){
+                    pc[l] += mask[l] && vx[l] == kk ? 2 : 0;
+                }
+                break;
+            case 0x4:
+                for (size_t l = 0; l < count; l++){
+                    pc[l] += mask[l] && vx[l] != kk ? 2 : 0;
+                }
+                break;
+            case 0x5:
+                for (size_t l = 0; l < count; l++){
+                    pc[l] += mask[l] && vx[l] == vy[l] ? 2 : 0;
+                }
+                break;
+            case 0x6:
+                for (size_t l = 0; l < count; l++){
+                    vx[l] = mask[l] ? kk : vx[l];
+                }
+                break;
+            case 0x7:
+                for (size_t l = 0; l < count; l++){
+                    vx[l] += mask[l] & kk;
+                }
+                break;
+            case 0x8:
+                switch (opcode & 0x000Fu){
+                    case 0x0:
+                        for (size_t l = 0; l < count; l++){
+                            vx[l] = mask[l] ? vy[l] : vx[l];
+                        }
+                        break;
+                    case 0x1:
+                        for (size_t l = 0; l < count; l++){
+                            vx[l] |= mask[l] & vy[l];
+                        }
+                        break;
+                    case 0x2:
+                        for (size_t l = 0; l < count; l++){
+                            vx[l] &= ~mask[l] | vy[l];
+                        }
+                        break;
+                    case 0x3:
+                        for (size_t l = 0; l < count; l++){
+                            vx[l] ^= mask[l] & vy[l];
+                        }
+                        break;
+                    case 0x4:
+                        for (size_t l = 0; l < count; l++){
+                            unsigned int sum = vx[l] + vy[l];
+                            vf[l] = mask[l] ? sum > 255u : vf[l];
+                            vx[l] = mask[l] ? static_cast<uint8_t>(sum) : vx[l];
+                        }
+                        break;
+                    case 0x5:
+                        for (size_t l = 0; l < count; l++){
+                            uint8_t flag = vx[l] > vy[l];
+                            vf[l] = mask[l] ? flag : vf[l];
+                            vx[l] = mask[l] ? static_cast<uint8_t>(vx[l] - vy[l]) : vx[l];
+                        }
+                        break;
+                    case 0x6:
+                        for (size_t l = 0; l < count; l++){
+                            uint8_t flag = vx[l] & 0x1u;
+                            vf[l] = mask[l] ? flag : vf[l];
+                            vx[l] = mask[l] ? static_cast<uint8_t>(vx[l] >> 1u) : vx[l];
+                        }
+                        break;
+                    case 0x7:
+                        for (size_t l = 0; l < count; l++){
+                            uint8_t flag = vy[l] > vx[l];
+                            vf[l] = mask[l] ? flag : vf[l];
+                            vx[l] = mask[l] ? static_cast<uint8_t>(vy[l] - vx[l]) : vx[l];
+                        }
+                        break;
+                    case 0xE:
+                        for (size_t l = 0; l < count; l++){
+                            uint8_t flag = (vx[l] & 0x80u) >> 7u;
+                            vf[l] = mask[l] ? flag : vf[l];
+                            vx[l] = mask[l] ? static_cast<uint8_t>(vx[l] << 1u) : vx[l];
+                        }
+                        break;
+                }
+                break;
+            case 0x9:
+                for (size_t l = 0; l < count; l++){
+                    pc[l] += mask[l] && vx[l] != vy[l] ? 2 : 0;
+                }
+                break;
+            case 0xA:
+                for (size_t l = 0; l < count; l++){
+                    index[l] = mask[l] ? nnn : index[l];
+                }
+                break;
+            case 0xB:
+                for (size_t l = 0; l < count; l++){
+                    pc[l] = mask[l] ? static_cast<uint16_t>(v0[l] + nnn) : pc[l];
+                }
+                break;
+            case 0xE:
+                switch (opcode & 0x000Fu){
+                    case 0xE:
+                        for (size_t l = 0; l < count; l++){
+                            bool down = (keys[l] >> (vx[l] & (KEY_COUNT - 1))) & 1u;
+                            pc[l] += mask[l] && down ? 2 : 0;
+                        }
+                        break;
+                    case 0x1:
+                        for (size_t l = 0; l < count; l++){
+                            bool down = (keys[l] >> (vx[l] & (KEY_COUNT - 1))) & 1u;
+                            pc[l] += mask[l] && !down ? 2 : 0;
+                        }
+                        break;
+                }
+                break;
+            case 0xF:
+                switch (kk){
+                    case 0x07:
+                        for (size_t l = 0; l < count; l++){
+                            uint32_t elapsed = ticks - delayTick[l];
+                            uint8_t delay = elapsed < delaySet[l] ? static_cast<uint8_t>(delaySet[l] - elapsed) : 0;
+                            vx[l] = mask[l] ? delay : vx[l];
+                        }
+                        break;
+                    case 0x15:
+                        for (size_t l = 0; l < count; l++){
+                            delaySet[l] = mask[l] ? vx[l] : delaySet[l];
+                            delayTick[l] = mask[l] ? ticks : delayTick[l];
+                        }
+                        break;
+                    case 0x18:
+                        for (size_t l = 0; l < count; l++){
+                            soundSet[l] = mask[l] ? vx[l] : soundSet[l];
+                            soundTick[l] = mask[l] ? ticks : soundTick[l];
+                        }
+                        break;
+                    case 0x1E:
+                        for (size_t l = 0; l < count; l++){
+                            index[l] += mask[l] & vx[l];
+                        }
+                        break;
+                    case 0x29:
+                        for (size_t l = 0; l < count; l++){
+                            index[l] = mask[l] ? static_cast<uint16_t>(FONTSET_START + 5 * vx[l]) : index[l];
+                        }
+                        break;
+                }
+                break;
+        }
+    }
+}
+
+    Chip8Batch::Chip8Batch(unsigned int lanes, uint32_t seed)
+        : lanes(lanes),
+          stride((lanes + LANE_ALIGN - 1) / LANE_ALIGN * LANE_ALIGN),
+          registers(REGISTER_COUNT * stride),
+          pc(stride, START_ADDRESS),
+          index(stride),
+          sp(stride),
+          stack(STACK_LEVELS * stride),
+          delaySet(stride),
+          soundSet(stride),
+          delayTick(stride),
+          soundTick(stride),
+          randState(stride),
+          keys(stride),
+          video(VIDEO_HEIGHT * stride),
+          remaining(stride),
+          mask(stride),
+          nextLane(stride),
+          head(MEMORY_SIZE, NO_LANE),
+          memory(static_cast<size_t>(lanes) * MEMORY_SIZE)
+    {
+        group.reserve(lanes);
+        std::copy(fontset, fontset + sizeof(fontset), image + FONTSET_START);
+
+        //Seeded the way Chip8(seed) seeds its RNG.
+        std::fill(randState.begin(), randState.end(), seed % MINSTD_MODULUS ? seed % MINSTD_MODULUS : 1);
+
+        for (unsigned int lane = 0; lane < lanes; lane++){
+            std::copy(image, image + MEMORY_SIZE, &memory[lane * MEMORY_SIZE]);
+        }
+    }
+
+    bool Chip8Batch::LoadROM(char const* filename){
+        std::ifstream file(filename, std::ios::binary);
+
+        if (!file.is_open()){
+            return false;
+        }
+
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return LoadROM(data.data(), data.size());
+    }
+
+    //Loads the same ROM into every lane.
+    bool Chip8Batch::LoadROM(uint8_t const* data, size_t size){
+        if (size > MEMORY_SIZE - START_ADDRESS){
+            return false;
+        }
+
+        std::copy(data, data + size, image + START_ADDRESS);
+        for (unsigned int lane = 0; lane < lanes; lane++){
+            std::copy(data, data + size, &memory[lane * MEMORY_SIZE + START_ADDRESS]);
+        }
+        return true;
+    }
+
+    uint64_t Chip8Batch::FrameHash(unsigned int lane) const{
+        uint64_t rows[VIDEO_HEIGHT];
+        for (unsigned int row = 0; row < VIDEO_HEIGHT; row++){
+            rows[row] = video[row * stride + lane];
+        }
+
+        uint64_t hash = 0xCBF29CE484222325ull;
+        uint8_t const* bytes = reinterpret_cast<uint8_t const*>(rows);
+
+        for (size_t i = 0; i < sizeof(rows); i++){
+            hash ^= bytes[i];
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    uint16_t Chip8Batch::Fetch(unsigned int lane, unsigned int address) const{
+        uint8_t const* laneMemory = &memory[lane * MEMORY_SIZE];
+        return static_cast<uint16_t>((laneMemory[address & (MEMORY_SIZE - 1)] << 8u) | laneMemory[(address + 1) & (MEMORY_SIZE - 1)]);
+    }
+
+    //Lanes are kept in one list per address they're at, and an address's lanes are taken
+    //lowest address first, so lanes that went round a loop a different number of times, or
+    //skipped ahead, catch each other up. Only the lanes in the list are visited, unless the
+    //step runs as a masked pass. While every lane is at the same address there are no lists
+    //at all, just a masked pass over all of them per instruction.
+    BatchStats Chip8Batch::RunFrame(uint64_t instructionsPerFrame){
+        BatchStats stats;
+        LaneArrays arrays{registers.data(), pc.data(), index.data(), delaySet.data(), soundSet.data(), delayTick.data(),
+                          soundTick.data(), keys.data(), video.data(), remaining.data(), mask.data(), stride, ticks};
+
+        std::fill(remaining.begin(), remaining.begin() + lanes, static_cast<uint32_t>(std::min<uint64_t>(instructionsPerFrame, UINT32_MAX)));
+
+        Span span = FindSpan(pc.data(), remaining.data(), stride);
+        size_t active = span.active;
+        bool converged = span.lowest == span.highest;
+
+        if (!converged){
+            SplitLanes();
+        }
+
+        while (active > 0){
+            if (converged){
+                unsigned int address = span.lowest;
+                uint16_t opcode = static_cast<uint16_t>((image[address] << 8u) | image[(address + 1) & (MEMORY_SIZE - 1)]);
+
+                if (!SameCode(address, opcode)){
+                    converged = false;
+                    SplitLanes();
+                    continue;
+                }
+
+                stats.steps++;
+                stats.instructions += active;
+
+                if (Maskable(opcode)){
+                    MaskActive(remaining.data(), mask.data(), stride);
+                    RunMasked(arrays, opcode);
+                    stats.vectorSteps++;
+                }
+                else {
+                    for (unsigned int lane = 0; lane < lanes; lane++){
+                        if (remaining[lane] != 0){
+                            stats.instructions -= !StepLane(lane, opcode);
+                            stats.scalarLanes++;
+                        }
+                    }
+                }
+
+                span = FindSpan(pc.data(), remaining.data(), stride);
+                active = span.active;
+                if (active > 0 && span.lowest != span.highest){
+                    converged = false;
+                    SplitLanes();
+                }
+                continue;
+            }
+
+            unsigned int address = TakeLowest(group);
+            unsigned int next = (address + 1) & (MEMORY_SIZE - 1);
+            uint16_t opcode = static_cast<uint16_t>((image[address] << 8u) | image[next]);
+
+            //Lanes may hold different code here. This step takes the lanes holding the same
+            //instruction as the first one, the others go back to wait for a step of their own.
+            if (written[address] || written[next]){
+                opcode = Fetch(group[0], address);
+                group.erase(std::remove_if(group.begin(), group.end(), [&](uint32_t lane){
+                    if (Fetch(lane, address) != opcode){
+                        Park(lane);
+                        return true;
+                    }
+                    return false;
+                }), group.end());
+            }
+
+            stats.steps++;
+
+            if (Maskable(opcode) && group.size() * SCALAR_FRACTION >= lanes){
+                for (uint32_t lane : group){
+                    mask[lane] = 0xFF;
+                }
+                RunMasked(arrays, opcode);
+                for (uint32_t lane : group){
+                    mask[lane] = 0;
+                }
+                stats.vectorSteps++;
+                stats.instructions += group.size();
+            }
+            else {
+                for (uint32_t lane : group){
+                    stats.instructions += StepLane(lane, opcode);
+                    stats.scalarLanes++;
+                }
+            }
+
+            for (uint32_t lane : group){
+                if (remaining[lane] != 0){
+                    Park(lane);
+                }
+                else {
+                    active--;
+                }
+            }
+
+            //Everything left has come back together.
+            if (occupied == 1 && active > 0){
+                span.lowest = TakeLowest(group);
+                converged = true;
+            }
+        }
+
+        ticks++;
+        return stats;
+    }
+
+    //True if every lane with instructions left holds opcode at address.
+    bool Chip8Batch::SameCode(unsigned int address, uint16_t opcode) const{
+        if (!written[address] && !written[(address + 1) & (MEMORY_SIZE - 1)]){
+            return true;
+        }
+        for (unsigned int lane = 0; lane < lanes; lane++){
+            if (remaining[lane] != 0 && Fetch(lane, address) != opcode){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //Puts every lane with instructions left on the list for its address.
+    void Chip8Batch::SplitLanes(){
+        std::fill(mask.begin(), mask.end(), 0);
+        for (unsigned int lane = 0; lane < lanes; lane++){
+            if (remaining[lane] != 0){
+                Park(lane);
+            }
+        }
+    }
+
+    void Chip8Batch::Park(uint32_t lane){
+        unsigned int address = pc[lane] & (MEMORY_SIZE - 1);
+
+        if (head[address] == NO_LANE){
+            used[address / 64] |= 1ull << (address % 64);
+            occupied++;
+        }
+        nextLane[lane] = head[address];
+        head[address] = lane;
+    }
+
+    //Empties the lowest address's list into lanes and returns the address.
+    unsigned int Chip8Batch::TakeLowest(std::vector<uint32_t>& taken){
+        unsigned int word = 0;
+        while (used[word] == 0){
+            word++;
+        }
+
+        unsigned int address = word * 64 + static_cast<unsigned int>(__builtin_ctzll(used[word]));
+        taken.clear();
+        for (uint32_t lane = head[address]; lane != NO_LANE; lane = nextLane[lane]){
+            taken.push_back(lane);
+        }
+
+        head[address] = NO_LANE;
+        used[word] &= used[word] - 1;
+        occupied--;
+        return address;
+    }
+
+    //One instruction on one lane, same decoding as the function pointer tables, aliases
+    //included, and same semantics as Chip8::Ops. False if it blocked in Fx0A, which ends the
+    //lane's frame with pc still on it.
+    bool Chip8Batch::StepLane(unsigned int lane, uint16_t opcode){
+        unsigned int x = (opcode & 0x0F00u) >> 8u;
+        unsigned int y = (opcode & 0x00F0u) >> 4u;
+        uint8_t kk = opcode & 0x00FFu;
+        uint16_t nnn = opcode & 0x0FFFu;
+        uint8_t* laneMemory = &memory[lane * MEMORY_SIZE];
+        auto V = [&](unsigned int i) -> uint8_t& { return registers[i * stride + lane]; };
+        uint16_t& lanePc = pc[lane];
+        uint16_t& laneIndex = index[lane];
+
+        lanePc += 2;
+        remaining[lane]--;
+
+        switch (opcode >> 12u){
+            case 0x0:
+                switch (opcode & 0x000Fu){
+                    case 0x0:
+                        for (unsigned int row = 0; row < VIDEO_HEIGHT; row++){
+                            video[row * stride + lane] = 0;
+                        }
+                        break;
+                    case 0xE:
+                        sp[lane]--;
+                        lanePc = stack[(sp[lane] & (STACK_LEVELS - 1)) * stride + lane];
+                        break;
+                }
+                break;
+            case 0x1: lanePc = nnn; break;
+            case 0x2:
+                stack[(sp[lane] & (STACK_LEVELS - 1)) * stride + lane] = lanePc;
+                sp[lane]++;
+                lanePc = nnn;
+                break;
+            case 0x3: lanePc += V(x) == kk ? 2 : 0; break;
+            case 0x4: lanePc += V(x) != kk ? 2 : 0; break;
+            case 0x5: lanePc += V(x) == V(y) ? 2 : 0; break;
+            case 0x6: V(x) = kk; break;
+            case 0x7: V(x) += kk; break;
+            case 0x8:
+                switch (opcode & 0x000Fu){
+                    case 0x0: V(x) = V(y); break;
+                    case 0x1: V(x) |= V(y); break;
+                    case 0x2: V(x) &= V(y); break;
+                    case 0x3: V(x) ^= V(y); break;
+                    case 0x4: {
+                        unsigned int sum = V(x) + V(y);
+                        V(0xF) = sum > 255u;
+                        V(x) = static_cast<uint8_t>(sum);
+                        break;
+                    }
+                    case 0x5: V(0xF) = V(x) > V(y); V(x) -= V(y); break;
+                    case 0x6: V(0xF) = V(x) & 0x1u; V(x) >>= 1; break;
+                    case 0x7: V(0xF) = V(y) > V(x); V(x) = V(y) - V(x); break;
+                    case 0xE: V(0xF) = (V(x) & 0x80u) >> 7u; V(x) <<= 1; break;
+                }
+                break;
+            case 0x9: lanePc += V(x) != V(y) ? 2 : 0; break;
+            case 0xA: laneIndex = nnn; break;
+            case 0xB: lanePc = V(0) + nnn; break;
+            case 0xC: {
+                //Chip8::Ops::RandomByte() on this lane's state.
+                const uint32_t scaling = (MINSTD_MODULUS - 3) / 256;
+                uint32_t& state = randState[lane];
+                uint32_t value;
+
+                do {
+                    state = static_cast<uint32_t>(uint64_t{state} * MINSTD_MULTIPLIER % MINSTD_MODULUS);
+                    value = state - 1;
+                } while (value >= 256 * scaling);
+                V(x) = static_cast<uint8_t>(value / scaling) & kk;
+                break;
+            }
+            case 0xD: DrawLane(lane, x, y, opcode & 0x000Fu); break;
+            case 0xE: {
+                bool down = (keys[lane] >> (V(x) & (KEY_COUNT - 1))) & 1u;
+                switch (opcode & 0x000Fu){
+                    case 0xE: lanePc += down ? 2 : 0; break;
+                    case 0x1: lanePc += down ? 0 : 2; break;
+                }
+                break;
+            }
+            case 0xF:
+                switch (kk){
+                    case 0x07: {
+                        uint32_t elapsed = ticks - delayTick[lane];
+                        V(x) = elapsed < delaySet[lane] ? static_cast<uint8_t>(delaySet[lane] - elapsed) : 0;
+                        break;
+                    }
+                    case 0x0A:
+                        for (unsigned int key = 0; key < KEY_COUNT; key++){
+                            if ((keys[lane] >> key) & 1u){
+                                V(x) = key;
+                                return true;
+                            }
+                        }
+                        lanePc -= 2;
+                        remaining[lane] = 0;
+                        return false;
+                    case 0x15: delaySet[lane] = V(x); delayTick[lane] = ticks; break;
+                    case 0x18: soundSet[lane] = V(x); soundTick[lane] = ticks; break;
+                    case 0x1E: laneIndex += V(x); break;
+                    case 0x29: laneIndex = FONTSET_START + 5 * V(x); break;
+                    case 0x33: {
+                        uint8_t value = V(x);
+                        for (unsigned int digit = 3; digit-- > 0; value /= 10){
+                            laneMemory[(laneIndex + digit) & (MEMORY_SIZE - 1)] = value % 10;
+                            written[(laneIndex + digit) & (MEMORY_SIZE - 1)] = 1;
+                        }
+                        break;
+                    }
+                    case 0x55:
+                        for (unsigned int i = 0; i <= x; i++){
+                            laneMemory[(laneIndex + i) & (MEMORY_SIZE - 1)] = V(i);
+                            written[(laneIndex + i) & (MEMORY_SIZE - 1)] = 1;
+                        }
+                        break;
+                    case 0x65:
+                        for (unsigned int i = 0; i <= x; i++){
+                            V(i) = laneMemory[(laneIndex + i) & (MEMORY_SIZE - 1)];
+                        }
+                        break;
+                }
+                break;
+        }
+        return true;
+    }
+
+    //Chip8::Ops::Draw() on a copy of the lane's display rows.
+    void Chip8Batch::DrawLane(unsigned int lane, unsigned int x, unsigned int y, unsigned int height){
+        uint8_t const* laneMemory = &memory[lane * MEMORY_SIZE];
+        uint8_t& vf = registers[0xF * stride + lane];
+        unsigned int xPos = registers[x * stride + lane] % VIDEO_WIDTH;
+        unsigned int yPos = registers[y * stride + lane] % VIDEO_HEIGHT;
+        uint8_t sprite[16];
+        uint64_t rows[VIDEO_HEIGHT];
+
+        for (unsigned int row = 0; row < height; row++){
+            sprite[row] = laneMemory[(index[lane] + row) & (MEMORY_SIZE - 1)];
+        }
+        for (unsigned int row = 0; row < VIDEO_HEIGHT; row++){
+            rows[row] = video[row * stride + lane];
+        }
+
+        bool wrapY = quirks.vertical == EdgeMode::Wrap;
+        uint64_t hit = quirks.horizontal == EdgeMode::Wrap
+            ? Chip8::Ops::BlitSprite<true>(rows, sprite, height, xPos, yPos, wrapY)
+            : Chip8::Ops::BlitSprite<false>(rows, sprite, height, xPos, yPos, wrapY);
+
+        for (unsigned int row = 0; row < VIDEO_HEIGHT; row++){
+            video[row * stride + lane] = rows[row];
+        }
+        vf = hit != 0;
+    }
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Chip8.hpp"
+
+//What one Chip8Batch::RunFrame() cost. Every step issues one instruction to all the lanes
+//that share a pc, so instructions / (steps * lanes) is the share of lane slots doing work.
+struct BatchStats {
+    uint64_t instructions{};    //Summed over lanes.
+    uint64_t steps{};
+    uint64_t vectorSteps{};     //Steps run across the lane arrays with a lane mask.
+    uint64_t scalarLanes{};     //Lane instructions run one lane at a time instead.
+
+    double Utilization(size_t lanes) const {
+        return steps ? static_cast<double>(instructions) / (static_cast<double>(steps) * lanes) : 0.0;
+    }
+};
+
+//Many instances of one ROM, each with its own keypad, run in lockstep. State is kept one array
+//per field, indexed by lane, so an instruction that every lane at the same pc runs is one pass
+//over the arrays with a lane mask, which the compiler vectorizes (AVX2/AVX-512 where the CPU has
+//them). Lanes whose pc has diverged wait their turn, and steps that only a few lanes take, or
+//that touch memory, the stack, the RNG or the display, run lane by lane.
+//Each lane ends every frame where a Chip8 with the same seed, quirks and keys would.
+class Chip8Batch {
+
+    public:
+        Chip8Batch(unsigned int lanes, uint32_t seed);
+        bool LoadROM(char const* filename);
+        bool LoadROM(uint8_t const* data, size_t size);
+        void SetQuirks(Quirks newQuirks) { quirks = newQuirks; }
+
+        //Runs instructionsPerFrame instructions on every lane, fewer on one blocked in Fx0A,
+        //then ticks the timers.
+        BatchStats RunFrame(uint64_t instructionsPerFrame);
+
+        unsigned int Lanes() const { return lanes; }
+        //Keys held in a lane, bit n for key n.
+        void SetKeys(unsigned int lane, uint16_t held) { keys[lane] = held; }
+        uint16_t PC(unsigned int lane) const { return pc[lane]; }
+        uint16_t Index(unsigned int lane) const { return index[lane]; }
+        uint8_t Register(unsigned int lane, unsigned int i) const { return registers[i * stride + lane]; }
+        //Same hash as Chip8::FrameHash().
+        uint64_t FrameHash(unsigned int lane) const;
+
+    private:
+        unsigned int lanes;
+        size_t stride;                      //lanes rounded up, padding lanes never run.
+        Quirks quirks{};
+        uint32_t ticks{};
+
+        std::vector<uint8_t> registers;     //REGISTER_COUNT arrays of stride.
+        std::vector<uint16_t> pc;
+        std::vector<uint16_t> index;
+        std::vector<uint8_t> sp;
+        std::vector<uint16_t> stack;        //STACK_LEVELS arrays of stride.
+        std::vector<uint8_t> delaySet;
+        std::vector<uint8_t> soundSet;
+        std::vector<uint32_t> delayTick;
+        std::vector<uint32_t> soundTick;
+        std::vector<uint32_t> randState;
+        std::vector<uint16_t> keys;
+        std::vector<uint64_t> video;        //VIDEO_HEIGHT arrays of stride.
+        std::vector<uint32_t> remaining;    //Instructions left this frame.
+        std::vector<uint8_t> mask;          //0xFF for lanes taking the current step.
+
+        //Lanes waiting for a step, one list per address, threaded through nextLane. used has
+        //a bit set for each address with a list, occupied counts them.
+        std::vector<uint32_t> nextLane;
+        std::vector<uint32_t> head;
+        uint64_t used[MEMORY_SIZE / 64]{};
+        unsigned int occupied{};
+        std::vector<uint32_t> group;
+
+        //Memory stays one block per lane. image is what every lane's memory starts as, and
+        //written marks addresses any lane has stored to: everywhere else all lanes fetch the
+        //same instruction straight from image.
+        std::vector<uint8_t> memory;
+        uint8_t image[MEMORY_SIZE]{};
+        uint8_t written[MEMORY_SIZE]{};
+
+        uint16_t Fetch(unsigned int lane, unsigned int address) const;
+        bool SameCode(unsigned int address, uint16_t opcode) const;
+        void SplitLanes();
+        void Park(uint32_t lane);
+        unsigned int TakeLowest(std::vector<uint32_t>& taken);
+        bool StepLane(unsigned int lane, uint16_t opcode);
+        void DrawLane(unsigned int lane, unsigned int x, unsigned int y, unsigned int height);
+};
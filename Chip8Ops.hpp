@@ -0,0 +1,504 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "Chip8.hpp"
+
+//Which of the optional dispatch backends this compiler can build.
+#if defined(__GNUC__)
+#define CHIP8_COMPUTED_GOTO 1
+#endif
+
+#if defined(__x86_64__) && defined(__linux__)
+#define CHIP8_JIT 1
+#endif
+
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define CHIP8_MUSTTAIL [[clang::musttail]]
+#elif __has_cpp_attribute(gnu::musttail)
+#define CHIP8_MUSTTAIL [[gnu::musttail]]
+#endif
+#endif
+
+const unsigned int START_ADDRESS = 0x200;
+const unsigned int FONTSET_START = 0x50;
+
+//Hex digit sprites loaded at FONTSET_START, defined in Chip8.cpp.
+extern uint8_t fontset[80];
+
+//std::minstd_rand0, the libstdc++ std::default_random_engine.
+const uint32_t MINSTD_MULTIPLIER = 16807;
+const uint32_t MINSTD_MODULUS = 2147483647;
+
+//Longest instruction sequence the Predecoded backend fuses into one superinstruction.
+const unsigned int MAX_FUSED = 3;
+
+//One predecoded instruction: its handler and its operands, already pulled out of the opcode.
+//A superinstruction keeps its first instruction's operands and reads the rest from the entries
+//after it, so it only ever runs from the predecoded cache.
+struct Chip8::Decoded {
+    void (*run)(Chip8& c, Decoded const& d);
+    uint16_t nnn;
+    uint8_t x;
+    uint8_t y;
+    uint8_t kk;
+    uint8_t n;
+    uint8_t length;     //Instructions run, always the same however its skips go.
+};
+
+//One page of memory. A fork shares its parent's pages until either of them writes to one.
+//bytes comes first, the Jit backend reads through a page pointer as if it pointed at them.
+struct Chip8::Page {
+    uint8_t bytes[MEMORY_PAGE_SIZE];
+    std::atomic<uint32_t> refs{1};      //Instances pointing at it.
+};
+
+//Superblocks translated to micro-ops: straight-line code, continuing through jumps and calls
+//to known addresses and past skips that aren't taken. Looked up by start address, flushed as a
+//whole when anything writes to memory a block was built from.
+struct Chip8::BlockCache {
+    struct MicroOp {
+        Decoded op;
+        uint16_t opcode;
+        uint16_t pc;        //pc while the instruction runs, the address just past it.
+        uint16_t next;      //Where the block carries on. Control ops leave it if pc ends up elsewhere.
+        bool control;       //Reads or changes pc, or writes memory.
+        bool end;           //Last op of its block: 00EE, Bnnn, Fx33 or Fx55.
+    };
+
+    //Native code for a block. Runs at least one pass of the block, more while it loops back to
+    //its start and budget is left for a whole pass. Returns the instructions run.
+    using NativeBlock = uint64_t (*)(Chip8* c, uint64_t budget);
+
+    struct Block {
+        uint32_t firstOp;
+        uint16_t length;
+        bool compiled;
+        NativeBlock native;
+    };
+
+    ~BlockCache();
+
+    uint16_t lookup[MEMORY_SIZE];       //1 + index into blocks, 0 when no block starts here.
+    uint8_t covered[MEMORY_SIZE];       //Non-zero for bytes some block was decoded from.
+    std::vector<Block> blocks;
+    std::vector<MicroOp> ops;
+    uint32_t generation;                //Bumped on every flush.
+
+    //Memory for the Jit backend, mapped the first time it compiles a block: the same pages as
+    //code, to run, and as codeWritable, to write. No view is writable and executable at once.
+    uint8_t* code{};
+    uint8_t* codeWritable{};
+    size_t codeUsed{};
+};
+
+//Instruction semantics shared by every dispatch backend. A backend only decides how operands
+//are decoded and how control gets to the next instruction; what an instruction does lives here.
+//Internal to the core, only included by its own translation units.
+struct Chip8::Ops {
+
+    //The byte at address. Addresses wrap at the end of memory.
+    static inline uint8_t Read(Chip8 const& c, unsigned int address){
+        address &= MEMORY_SIZE - 1;
+        return c.pages[address / MEMORY_PAGE_SIZE]->bytes[address % MEMORY_PAGE_SIZE];
+    }
+
+    //The byte at address, to store to. A page still shared with a fork is copied first.
+    static inline uint8_t& Write(Chip8& c, unsigned int address){
+        address &= MEMORY_SIZE - 1;
+        Page* page = c.pages[address / MEMORY_PAGE_SIZE];
+
+        if (page->refs.load(std::memory_order_acquire) != 1){
+            page = Unshare(c, address / MEMORY_PAGE_SIZE);
+        }
+        return page->bytes[address % MEMORY_PAGE_SIZE];
+    }
+
+    //Fetch the big-endian instruction word at address. Addresses wrap at the end of memory.
+    static inline uint16_t Fetch(Chip8 const& c, unsigned int address){
+        address &= MEMORY_SIZE - 1;
+        unsigned int offset = address % MEMORY_PAGE_SIZE;
+
+        if (address - offset != c.fetchBase){
+            c.fetchBase = static_cast<uint16_t>(address - offset);
+            c.fetchBytes = c.pages[address / MEMORY_PAGE_SIZE]->bytes;
+        }
+
+        //Both bytes are on one page unless the word straddles two.
+        if (offset != MEMORY_PAGE_SIZE - 1){
+            return static_cast<uint16_t>((c.fetchBytes[offset] << 8u) | c.fetchBytes[offset + 1]);
+        }
+        return static_cast<uint16_t>((c.fetchBytes[offset] << 8u) | Read(c, address + 1));
+    }
+
+    //Memory at [address, address + length) changed, drop anything decoded from it.
+    static inline void CodeWritten(Chip8& c, unsigned int address, unsigned int length){
+        if (c.predecoded){
+            InvalidatePredecoded(c, address, length);
+        }
+        if (c.blockCache){
+            InvalidateBlocks(c, address, length);
+        }
+        if (c.aot){
+            InvalidateAot(c, address, length);
+        }
+    }
+
+    //Fetch the instruction at pc and step past it.
+    static inline uint16_t FetchNext(Chip8& c){
+        uint16_t opcode = Fetch(c, c.pc);
+        c.pc += 2;
+        return opcode;
+    }
+
+    //Clear display (CLS)
+    static inline void Cls(Chip8& c){
+        std::memset(c.video, 0, sizeof(c.video));
+        c.MarkDirty(0, VIDEO_HEIGHT - 1);
+        c.drawFlag = true;
+    }
+
+    //Return from a subroutine(RET)
+    static inline void Ret(Chip8& c){
+        c.sp--;
+        c.pc = c.stack[c.sp & (STACK_LEVELS - 1)];
+    }
+
+    //Jump to a location (nnn)
+    static inline void Jump(Chip8& c, uint16_t address){
+        c.pc = address;
+    }
+
+    //Call subroutine at nnn
+    static inline void Call(Chip8& c, uint16_t address){
+        c.stack[c.sp & (STACK_LEVELS - 1)] = c.pc;
+        c.sp++;
+        c.pc = address;
+    }
+
+    //Skip next instruction if Vx == kk
+    static inline void SkipIfEqual(Chip8& c, unsigned int x, uint8_t byte){
+        if (c.registers[x] == byte){
+            c.pc += 2;
+        }
+    }
+
+    //Skip next instruction if Vx != kk
+    static inline void SkipIfNotEqual(Chip8& c, unsigned int x, uint8_t byte){
+        if (c.registers[x] != byte){
+            c.pc += 2;
+        }
+    }
+
+    //Skip next instruction if Vx == Vy
+    static inline void SkipIfRegistersEqual(Chip8& c, unsigned int x, unsigned int y){
+        if (c.registers[x] == c.registers[y]){
+            c.pc += 2;
+        }
+    }
+
+    //Skip next instruction if Vx != Vy.
+    static inline void SkipIfRegistersNotEqual(Chip8& c, unsigned int x, unsigned int y){
+        if (c.registers[x] != c.registers[y]){
+            c.pc += 2;
+        }
+    }
+
+    //Set Vx to kk
+    static inline void Set(Chip8& c, unsigned int x, uint8_t byte){
+        c.registers[x] = byte;
+    }
+
+    //Add Vx and kk values
+    static inline void AddImmediate(Chip8& c, unsigned int x, uint8_t byte){
+        c.registers[x] += byte;
+    }
+
+    //Sets Vx to Vy
+    static inline void Move(Chip8& c, unsigned int x, unsigned int y){
+        c.registers[x] = c.registers[y];
+    }
+
+    //Set Vx or Vy
+    static inline void Or(Chip8& c, unsigned int x, unsigned int y){
+        c.registers[x] |= c.registers[y];
+    }
+
+    //Set Vx to Vx AND Vy
+    static inline void And(Chip8& c, unsigned int x, unsigned int y){
+        c.registers[x] &= c.registers[y];
+    }
+
+    //Set VX = Vx XOR Vy
+    static inline void Xor(Chip8& c, unsigned int x, unsigned int y){
+        c.registers[x] ^= c.registers[y];
+    }
+
+    //Add Vx and Vy, with carry value Vf. Vx is written last, so 8Fy4 leaves the sum in Vf.
+    static inline void Add(Chip8& c, unsigned int x, unsigned int y){
+        uint16_t sum = c.registers[x] + c.registers[y];
+
+        c.registers[0xF] = sum > 255U;
+        c.registers[x] = sum & 0xFFu;
+    }
+
+    //Subtract Vx and Vy, Vf set to not borrow. Vf is written first and the operands read after it.
+    static inline void Sub(Chip8& c, unsigned int x, unsigned int y){
+        c.registers[0xF] = c.registers[x] > c.registers[y];
+        c.registers[x] -= c.registers[y];
+    }
+
+    //If the least sig bit of Vx is 1, Vf gets set to 1. Vx is divided by 2 (right shift).
+    static inline void ShiftRight(Chip8& c, unsigned int x){
+        c.registers[0xF] = (c.registers[x] & 0x1u);
+        c.registers[x] >>= 1;
+    }
+
+    //Subtract Vy and Vx, Vf set to not borrow
+    static inline void SubReverse(Chip8& c, unsigned int x, unsigned int y){
+        c.registers[0xF] = c.registers[y] > c.registers[x];
+        c.registers[x] = c.registers[y] - c.registers[x];
+    }
+
+    //If the most sig bit of Vx is 1 then Vf is set to 1. Then Vx is multiplied by 2 (left shift)
+    static inline void ShiftLeft(Chip8& c, unsigned int x){
+        c.registers[0xF] = (c.registers[x] & 0x80u) >> 7u;
+        c.registers[x] <<= 1;
+    }
+
+    //Sets index to address(nnn)
+    static inline void SetIndex(Chip8& c, uint16_t address){
+        c.index = address;
+    }
+
+    //Jumps to Location nnn + V0
+    static inline void JumpOffset(Chip8& c, uint16_t address){
+        c.pc = c.registers[0] + address;
+    }
+
+    //std::minstd_rand0 narrowed to a byte the way libstdc++'s uniform_int_distribution does it,
+    //so a given seed gives the same numbers as the std::random objects this replaced.
+    static inline uint8_t RandomByte(Chip8& c){
+        const uint32_t scaling = (MINSTD_MODULUS - 3) / 256;
+        uint32_t value;
+
+        do {
+            c.randState = static_cast<uint32_t>(uint64_t{c.randState} * MINSTD_MULTIPLIER % MINSTD_MODULUS);
+            value = c.randState - 1;
+        } while (value >= 256 * scaling);
+        return static_cast<uint8_t>(value / scaling);
+    }
+
+    //Sets Vx to randomByte and kk
+    static inline void Random(Chip8& c, unsigned int x, uint8_t byte){
+        c.registers[x] = RandomByte(c) & byte;
+    }
+
+    //XORs count sprite rows onto consecutive screen rows, returns the OR of all collisions.
+    //Wrapping rotates the pixels past the right edge round to the left, clipping shifts them out.
+    template <bool WrapX>
+    static inline uint64_t BlitRows(uint64_t* screen, uint8_t const* sprite, unsigned int count, unsigned int xPos){
+        uint64_t hit = 0;
+
+        for (unsigned int row = 0; row < count; row++){
+            uint64_t bits = static_cast<uint64_t>(sprite[row]) << 56u;
+            uint64_t spriteRow = bits >> xPos;
+
+            if (WrapX){
+                spriteRow |= bits << ((VIDEO_WIDTH - xPos) & 63u);
+            }
+
+            hit |= screen[row] & spriteRow;
+            screen[row] ^= spriteRow;
+        }
+        return hit;
+    }
+
+    template <bool WrapX>
+    static inline uint64_t BlitSprite(uint64_t* video, uint8_t const* sprite, unsigned int height, unsigned int xPos, unsigned int yPos, bool wrapY){
+        //Rows past the bottom are dropped, or drawn from the top of the screen when wrapping.
+        unsigned int firstRows = std::min<unsigned int>(height, VIDEO_HEIGHT - yPos);
+        uint64_t hit = BlitRows<WrapX>(&video[yPos], sprite, firstRows, xPos);
+
+        if (wrapY){
+            hit |= BlitRows<WrapX>(&video[0], sprite + firstRows, height - firstRows, xPos);
+        }
+        return hit;
+    }
+
+    //Display n-byte sprite staritng at memory location I at (Vx,Vy), Vf tracks collision
+    static inline void Draw(Chip8& c, unsigned int x, unsigned int y, unsigned int height){
+        //The starting position always wraps.
+        unsigned int xPos = c.registers[x] % VIDEO_WIDTH;
+        unsigned int yPos = c.registers[y] % VIDEO_HEIGHT;
+
+        //Sprite data running into the next page is gathered from both, and data running off
+        //the end of memory wraps to address 0.
+        unsigned int start = c.index & (MEMORY_SIZE - 1);
+        uint8_t const* sprite = &c.pages[start / MEMORY_PAGE_SIZE]->bytes[start % MEMORY_PAGE_SIZE];
+        uint8_t gathered[16];
+
+        if (start % MEMORY_PAGE_SIZE + height > MEMORY_PAGE_SIZE){
+            for (unsigned int row = 0; row < height; row++){
+                gathered[row] = Read(c, start + row);
+            }
+            sprite = gathered;
+        }
+
+        bool wrapY = c.quirks.vertical == EdgeMode::Wrap;
+        uint64_t hit = c.quirks.horizontal == EdgeMode::Wrap
+            ? BlitSprite<true>(c.video, sprite, height, xPos, yPos, wrapY)
+            : BlitSprite<false>(c.video, sprite, height, xPos, yPos, wrapY);
+
+        //Any sprite pixel landing on a lit screen pixel is a collision.
+        c.registers[0xF] = hit != 0;
+        c.drawFlag = true;
+
+        //A sprite wrapping past the bottom touches both ends of the screen, mark all of it.
+        if (height > 0){
+            if (wrapY && yPos + height > VIDEO_HEIGHT){
+                c.MarkDirty(0, VIDEO_HEIGHT - 1);
+            }
+            else {
+                c.MarkDirty(yPos, std::min<unsigned int>(yPos + height, VIDEO_HEIGHT) - 1);
+            }
+        }
+    }
+
+    //Skip next instruction if key with value of Vx is pressed
+    static inline void SkipIfKey(Chip8& c, unsigned int x){
+        if (c.keypad[c.registers[x] & (KEY_COUNT - 1)]){
+            c.pc += 2;
+        }
+    }
+
+    //Skip next instruction if key with value of Vx is not pressed
+    static inline void SkipIfNotKey(Chip8& c, unsigned int x){
+        if (!c.keypad[c.registers[x] & (KEY_COUNT - 1)]){
+            c.pc += 2;
+        }
+    }
+
+    //Set Vx to the value of the delay timer
+    static inline void GetDelay(Chip8& c, unsigned int x){
+        c.registers[x] = c.DelayTimer();
+    }
+
+    //Wait for a keypress, store the lowest pressed key in Vx. Until then pc stays on this
+    //instruction and the backends return straight away, without counting it.
+    static inline void WaitKey(Chip8& c, unsigned int x){
+        for (unsigned int key = 0; key < KEY_COUNT; key++){
+            if (c.keypad[key]){
+                c.registers[x] = key;
+                return;
+            }
+        }
+        c.pc -= 2;
+        c.waitingForKey = true;
+    }
+
+    //Set delayTimer to Vx
+    static inline void SetDelay(Chip8& c, unsigned int x){
+        c.delaySet = c.registers[x];
+        c.delayTick = c.ticks;
+    }
+
+    //Set soundTimer to Vx
+    static inline void SetSound(Chip8& c, unsigned int x){
+        c.soundSet = c.registers[x];
+        c.soundTick = c.ticks;
+    }
+
+    //Set index to index + Vx
+    static inline void AddIndex(Chip8& c, unsigned int x){
+        c.index += c.registers[x];
+    }
+
+    //Index is set to the location of sprite for digit Vx
+    static inline void FontCharacter(Chip8& c, unsigned int x){
+        c.index = FONTSET_START + (5 * c.registers[x]);
+    }
+
+    //Store BCD rep of Vx in memory locations I, I + 1, I + 2
+    static inline void Bcd(Chip8& c, unsigned int x){
+        uint8_t value = c.registers[x];
+
+        //Ones
+        Write(c, c.index + 2) = value % 10;
+        value /= 10;
+
+        //Tens
+        Write(c, c.index + 1) = value % 10;
+        value /= 10;
+
+        //Hundreds
+        Write(c, c.index) = value % 10;
+
+        CodeWritten(c, c.index, 3);
+    }
+
+    //Store registers V0 through Vx in memory at location I
+    static inline void Store(Chip8& c, unsigned int x){
+        for (unsigned int i = 0; i <= x; i++){
+            Write(c, c.index + i) = c.registers[i];
+        }
+
+        CodeWritten(c, c.index, x + 1);
+    }
+
+    //Read registers V0 through Vx in memory at location I
+    static inline void Load(Chip8& c, unsigned int x){
+        for (unsigned int i = 0; i <= x; i++){
+            c.registers[i] = Read(c, c.index + i);
+        }
+    }
+
+    //Register and key reads for code generated by chip8-aot, which has no other way in.
+    static inline uint8_t& V(Chip8& c, unsigned int x){
+        return c.registers[x];
+    }
+
+    static inline bool KeyDown(Chip8 const& c, unsigned int x){
+        return c.keypad[c.registers[x] & (KEY_COUNT - 1)] != 0;
+    }
+
+    static inline bool AotLoaded(Chip8 const& c){
+        return c.aot != nullptr;
+    }
+
+    static inline bool WaitingForKey(Chip8 const& c){
+        return c.waitingForKey;
+    }
+
+    //Dispatch backends, each runs count instructions, or stops short when Fx0A blocks.
+    //They return how many ran, the blocked Fx0A not included.
+    static uint64_t RunTables(Chip8& c, uint64_t count);
+    static uint64_t RunDecodeTable(Chip8& c, uint64_t count);
+    static uint64_t RunSwitch(Chip8& c, uint64_t count);
+    static uint64_t RunThreaded(Chip8& c, uint64_t count);
+    static uint64_t RunTailCall(Chip8& c, uint64_t count);
+    static uint64_t RunPredecoded(Chip8& c, uint64_t count);
+
+    static uint64_t RunBlocks(Chip8& c, uint64_t count);
+    static void RunMicroOp(Chip8& c, BlockCache::MicroOp const& micro);
+    static uint64_t RunJit(Chip8& c, uint64_t count);
+    template <bool Jit>
+    static uint64_t RunBlockTier(Chip8& c, uint64_t count);
+    static BlockCache::NativeBlock CompileBlock(Chip8& c, BlockCache::Block const& block);
+    static uint64_t RunAot(Chip8& c, uint64_t count);
+
+    static Page* Unshare(Chip8& c, unsigned int page);
+    static Decoded DecodeOpcode(uint16_t opcode);
+    static void PredecodeMiss(Chip8& c, Decoded const& d);
+    static Decoded Fuse(Chip8& c, unsigned int address, Decoded const& first);
+    static void RunFusedTail(Chip8& c);
+    static void InvalidatePredecoded(Chip8& c, unsigned int address, unsigned int length);
+    static void InvalidateBlocks(Chip8& c, unsigned int address, unsigned int length);
+    static AotProgram const* FindAot(uint8_t const* rom, size_t size);
+    static Idle SkipIdle(Chip8& c, uint64_t count);
+    static void InvalidateAot(Chip8& c, unsigned int address, unsigned int length);
+};
@@ -0,0 +1,244 @@
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include <array>
+#include <cstdint>
+#include <utility>
+
+//Decode table backend. Every 16-bit opcode word maps straight to a handler, with the register
+//operands baked into the handler as template arguments. Immediates (kk, nnn, n) are still read
+//from the opcode: specializing on them too would need 65536 instantiations, which takes minutes
+//to compile and bloats the binary for no measurable gain over a single mask.
+
+namespace {
+
+    using Handler = void (*)(Chip8& c, uint16_t opcode);
+
+    struct OP_NULL { static void Run(Chip8&, uint16_t){} };
+    struct OP_00E0 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Cls(c); } };
+    struct OP_00EE { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Ret(c); } };
+    struct OP_1nnn { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::Jump(c, opcode & 0x0FFFu); } };
+    struct OP_2nnn { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::Call(c, opcode & 0x0FFFu); } };
+    struct OP_Annn { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::SetIndex(c, opcode & 0x0FFFu); } };
+    struct OP_Bnnn { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::JumpOffset(c, opcode & 0x0FFFu); } };
+
+    template <unsigned X> struct OP_3xkk { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::SkipIfEqual(c, X, static_cast<uint8_t>(opcode)); } };
+    template <unsigned X> struct OP_4xkk { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::SkipIfNotEqual(c, X, static_cast<uint8_t>(opcode)); } };
+    template <unsigned X> struct OP_6xkk { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::Set(c, X, static_cast<uint8_t>(opcode)); } };
+    template <unsigned X> struct OP_7xkk { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::AddImmediate(c, X, static_cast<uint8_t>(opcode)); } };
+    template <unsigned X> struct OP_Cxkk { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::Random(c, X, static_cast<uint8_t>(opcode)); } };
+    template <unsigned X> struct OP_8xy6 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::ShiftRight(c, X); } };
+    template <unsigned X> struct OP_8xyE { static void Run(Chip8& c, uint16_t){ Chip8::Ops::ShiftLeft(c, X); } };
+    template <unsigned X> struct OP_Ex9E { static void Run(Chip8& c, uint16_t){ Chip8::Ops::SkipIfKey(c, X); } };
+    template <unsigned X> struct OP_ExA1 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::SkipIfNotKey(c, X); } };
+    template <unsigned X> struct OP_Fx07 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::GetDelay(c, X); } };
+    template <unsigned X> struct OP_Fx0A { static void Run(Chip8& c, uint16_t){ Chip8::Ops::WaitKey(c, X); } };
+    template <unsigned X> struct OP_Fx15 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::SetDelay(c, X); } };
+    template <unsigned X> struct OP_Fx18 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::SetSound(c, X); } };
+    template <unsigned X> struct OP_Fx1E { static void Run(Chip8& c, uint16_t){ Chip8::Ops::AddIndex(c, X); } };
+    template <unsigned X> struct OP_Fx29 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::FontCharacter(c, X); } };
+    template <unsigned X> struct OP_Fx33 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Bcd(c, X); } };
+    template <unsigned X> struct OP_Fx55 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Store(c, X); } };
+    template <unsigned X> struct OP_Fx65 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Load(c, X); } };
+
+    template <unsigned X, unsigned Y> struct OP_5xy0 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::SkipIfRegistersEqual(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_8xy0 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Move(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_8xy1 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Or(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_8xy2 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::And(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_8xy3 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Xor(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_8xy4 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Add(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_8xy5 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::Sub(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_8xy7 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::SubReverse(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_9xy0 { static void Run(Chip8& c, uint16_t){ Chip8::Ops::SkipIfRegistersNotEqual(c, X, Y); } };
+    template <unsigned X, unsigned Y> struct OP_Dxyn { static void Run(Chip8& c, uint16_t opcode){ Chip8::Ops::Draw(c, X, Y, opcode & 0x000Fu); } };
+
+    //A table entry for instruction Op. Entry<Op>::Run is what the table stores, which lets the
+    //decode table and the tail-call backend share one decoder.
+    template <typename Op>
+    using Direct = Op;
+
+    //Handlers for each value of x, indexed by x.
+    template <typename Fn, template <typename> class Entry, template <unsigned> class Op, size_t... I>
+    constexpr std::array<Fn, 16> MakeX(std::index_sequence<I...>){
+        return {{ &Entry<Op<I>>::Run... }};
+    }
+
+    template <typename Fn, template <typename> class Entry, template <unsigned> class Op>
+    constexpr std::array<Fn, 16> XTable(){
+        return MakeX<Fn, Entry, Op>(std::make_index_sequence<16>{});
+    }
+
+    //Handlers for each pair of x and y, indexed by (x << 4) | y.
+    template <typename Fn, template <typename> class Entry, template <unsigned, unsigned> class Op, size_t... I>
+    constexpr std::array<Fn, 256> MakeXY(std::index_sequence<I...>){
+        return {{ &Entry<Op<(I >> 4u), (I & 0xFu)>>::Run... }};
+    }
+
+    template <typename Fn, template <typename> class Entry, template <unsigned, unsigned> class Op>
+    constexpr std::array<Fn, 256> XYTable(){
+        return MakeXY<Fn, Entry, Op>(std::make_index_sequence<256>{});
+    }
+
+    //Decodes exactly like the function pointer tables, including which unused encodings alias
+    //real instructions (0x0nn0 clears the screen, 0xEx91 is ExA1) and which do nothing.
+    template <typename Fn, template <typename> class Entry>
+    constexpr std::array<Fn, 65536> BuildTable(){
+        constexpr auto op3xkk = XTable<Fn, Entry, OP_3xkk>();
+        constexpr auto op4xkk = XTable<Fn, Entry, OP_4xkk>();
+        constexpr auto op6xkk = XTable<Fn, Entry, OP_6xkk>();
+        constexpr auto op7xkk = XTable<Fn, Entry, OP_7xkk>();
+        constexpr auto opCxkk = XTable<Fn, Entry, OP_Cxkk>();
+        constexpr auto op8xy6 = XTable<Fn, Entry, OP_8xy6>();
+        constexpr auto op8xyE = XTable<Fn, Entry, OP_8xyE>();
+        constexpr auto opEx9E = XTable<Fn, Entry, OP_Ex9E>();
+        constexpr auto opExA1 = XTable<Fn, Entry, OP_ExA1>();
+        constexpr auto opFx07 = XTable<Fn, Entry, OP_Fx07>();
+        constexpr auto opFx0A = XTable<Fn, Entry, OP_Fx0A>();
+        constexpr auto opFx15 = XTable<Fn, Entry, OP_Fx15>();
+        constexpr auto opFx18 = XTable<Fn, Entry, OP_Fx18>();
+        constexpr auto opFx1E = XTable<Fn, Entry, OP_Fx1E>();
+        constexpr auto opFx29 = XTable<Fn, Entry, OP_Fx29>();
+        constexpr auto opFx33 = XTable<Fn, Entry, OP_Fx33>();
+        constexpr auto opFx55 = XTable<Fn, Entry, OP_Fx55>();
+        constexpr auto opFx65 = XTable<Fn, Entry, OP_Fx65>();
+
+        constexpr auto op5xy0 = XYTable<Fn, Entry, OP_5xy0>();
+        constexpr auto op8xy0 = XYTable<Fn, Entry, OP_8xy0>();
+        constexpr auto op8xy1 = XYTable<Fn, Entry, OP_8xy1>();
+        constexpr auto op8xy2 = XYTable<Fn, Entry, OP_8xy2>();
+        constexpr auto op8xy3 = XYTable<Fn, Entry, OP_8xy3>();
+        constexpr auto op8xy4 = XYTable<Fn, Entry, OP_8xy4>();
+        constexpr auto op8xy5 = XYTable<Fn, Entry, OP_8xy5>();
+        constexpr auto op8xy7 = XYTable<Fn, Entry, OP_8xy7>();
+        constexpr auto op9xy0 = XYTable<Fn, Entry, OP_9xy0>();
+        constexpr auto opDxyn = XYTable<Fn, Entry, OP_Dxyn>();
+
+        std::array<Fn, 65536> table{};
+
+        for (unsigned int opcode = 0; opcode < 65536; opcode++){
+            unsigned int x = (opcode & 0x0F00u) >> 8u;
+            unsigned int xy = (opcode & 0x0FF0u) >> 4u;
+            Fn handler = &Entry<OP_NULL>::Run;
+
+            switch (opcode >> 12u){
+                case 0x0:
+                    if ((opcode & 0x000Fu) == 0x0){ handler = &Entry<OP_00E0>::Run; }
+                    if ((opcode & 0x000Fu) == 0xE){ handler = &Entry<OP_00EE>::Run; }
+                    break;
+                case 0x1: handler = &Entry<OP_1nnn>::Run; break;
+                case 0x2: handler = &Entry<OP_2nnn>::Run; break;
+                case 0x3: handler = op3xkk[x]; break;
+                case 0x4: handler = op4xkk[x]; break;
+                case 0x5: handler = op5xy0[xy]; break;
+                case 0x6: handler = op6xkk[x]; break;
+                case 0x7: handler = op7xkk[x]; break;
+                case 0x8:
+                    switch (opcode & 0x000Fu){
+                        case 0x0: handler = op8xy0[xy]; break;
+                        case 0x1: handler = op8xy1[xy]; break;
+                        case 0x2: handler = op8xy2[xy]; break;
+                        case 0x3: handler = op8xy3[xy]; break;
+                        case 0x4: handler = op8xy4[xy]; break;
+                        case 0x5: handler = op8xy5[xy]; break;
+                        case 0x6: handler = op8xy6[x]; break;
+                        case 0x7: handler = op8xy7[xy]; break;
+                        case 0xE: handler = op8xyE[x]; break;
+                    }
+                    break;
+                case 0x9: handler = op9xy0[xy]; break;
+                case 0xA: handler = &Entry<OP_Annn>::Run; break;
+                case 0xB: handler = &Entry<OP_Bnnn>::Run; break;
+                case 0xC: handler = opCxkk[x]; break;
+                case 0xD: handler = opDxyn[xy]; break;
+                case 0xE:
+                    if ((opcode & 0x000Fu) == 0x1){ handler = opExA1[x]; }
+                    if ((opcode & 0x000Fu) == 0xE){ handler = opEx9E[x]; }
+                    break;
+                case 0xF:
+                    switch (opcode & 0x00FFu){
+                        case 0x07: handler = opFx07[x]; break;
+                        case 0x0A: handler = opFx0A[x]; break;
+                        case 0x15: handler = opFx15[x]; break;
+                        case 0x18: handler = opFx18[x]; break;
+                        case 0x1E: handler = opFx1E[x]; break;
+                        case 0x29: handler = opFx29[x]; break;
+                        case 0x33: handler = opFx33[x]; break;
+                        case 0x55: handler = opFx55[x]; break;
+                        case 0x65: handler = opFx65[x]; break;
+                    }
+                    break;
+            }
+            table[opcode] = handler;
+        }
+        return table;
+    }
+
+    constexpr std::array<Handler, 65536> DECODE_TABLE = BuildTable<Handler, Direct>();
+
+#ifdef CHIP8_MUSTTAIL
+
+    using TailHandler = uint64_t (*)(Chip8& c, uint16_t opcode, uint64_t remaining);
+
+    struct TailTable {
+        static const std::array<TailHandler, 65536> entries;
+    };
+
+    //Runs Op, then jumps straight into the next instruction's handler. musttail guarantees the
+    //jump, so the stack stays flat however many instructions are chained. Returns how many of
+    //the instructions were left unrun, the blocked Fx0A included.
+    template <typename Op>
+    struct Tail {
+        static uint64_t Run(Chip8& c, uint16_t opcode, uint64_t remaining){
+            Op::Run(c, opcode);
+
+            if (Chip8::Ops::WaitingForKey(c)){
+                return remaining;
+            }
+            if (--remaining == 0){
+                return 0;
+            }
+
+            uint16_t next = Chip8::Ops::FetchNext(c);
+            CHIP8_MUSTTAIL return TailTable::entries[next](c, next, remaining);
+        }
+    };
+
+    const std::array<TailHandler, 65536> TailTable::entries = BuildTable<TailHandler, Tail>();
+
+#endif
+}
+
+
+    //One indirect call per instruction, no decoding at run time.
+    uint64_t Chip8::Ops::RunDecodeTable(Chip8& c, uint64_t count){
+        for (uint64_t i = 0; i < count; i++){
+            uint16_t opcode = Fetch(c, c.pc);
+            c.pc += 2;
+            DECODE_TABLE[opcode](c, opcode);
+
+            if (c.waitingForKey){
+                return i;
+            }
+        }
+        return count;
+    }
+
+#ifdef CHIP8_MUSTTAIL
+
+    uint64_t Chip8::Ops::RunTailCall(Chip8& c, uint64_t count){
+        if (count == 0){
+            return 0;
+        }
+
+        uint16_t opcode = Fetch(c, c.pc);
+        c.pc += 2;
+        return count - TailTable::entries[opcode](c, opcode, count);
+    }
+
+#else
+
+    //Not reachable, SetDispatch() doesn't select this backend without musttail.
+    uint64_t Chip8::Ops::RunTailCall(Chip8& c, uint64_t count){
+        return RunDecodeTable(c, count);
+    }
+
+#endif
@@ -0,0 +1,195 @@
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include <cstdint>
+
+//Single-function dispatch backends. Everything is inlined into one loop, so the compiler can
+//keep pc and the loop counter in registers instead of going through a call per instruction.
+
+    //Dense switch on the opcode's high nibble, then on its low bits where they select the instruction.
+    uint64_t Chip8::Ops::RunSwitch(Chip8& c, uint64_t count){
+        for (uint64_t i = 0; i < count; i++){
+            uint16_t opcode = Fetch(c, c.pc);
+            unsigned int x = (opcode & 0x0F00u) >> 8u;
+            unsigned int y = (opcode & 0x00F0u) >> 4u;
+            uint8_t byte = opcode & 0x00FFu;
+            uint16_t address = opcode & 0x0FFFu;
+
+            c.pc += 2;
+
+            switch (opcode >> 12u){
+                case 0x0:
+                    switch (opcode & 0x000Fu){
+                        case 0x0: Cls(c); break;
+                        case 0xE: Ret(c); break;
+                    }
+                    break;
+                case 0x1: Jump(c, address); break;
+                case 0x2: Call(c, address); break;
+                case 0x3: SkipIfEqual(c, x, byte); break;
+                case 0x4: SkipIfNotEqual(c, x, byte); break;
+                case 0x5: SkipIfRegistersEqual(c, x, y); break;
+                case 0x6: Set(c, x, byte); break;
+                case 0x7: AddImmediate(c, x, byte); break;
+                case 0x8:
+                    switch (opcode & 0x000Fu){
+                        case 0x0: Move(c, x, y); break;
+                        case 0x1: Or(c, x, y); break;
+                        case 0x2: And(c, x, y); break;
+                        case 0x3: Xor(c, x, y); break;
+                        case 0x4: Add(c, x, y); break;
+                        case 0x5: Sub(c, x, y); break;
+                        case 0x6: ShiftRight(c, x); break;
+                        case 0x7: SubReverse(c, x, y); break;
+                        case 0xE: ShiftLeft(c, x); break;
+                    }
+                    break;
+                case 0x9: SkipIfRegistersNotEqual(c, x, y); break;
+                case 0xA: SetIndex(c, address); break;
+                case 0xB: JumpOffset(c, address); break;
+                case 0xC: Random(c, x, byte); break;
+                case 0xD: Draw(c, x, y, opcode & 0x000Fu); break;
+                case 0xE:
+                    switch (opcode & 0x000Fu){
+                        case 0x1: SkipIfNotKey(c, x); break;
+                        case 0xE: SkipIfKey(c, x); break;
+                    }
+                    break;
+                case 0xF:
+                    switch (byte){
+                        case 0x07: GetDelay(c, x); break;
+                        case 0x0A:
+                            WaitKey(c, x);
+                            if (c.waitingForKey){
+                                return i;
+                            }
+                            break;
+                        case 0x15: SetDelay(c, x); break;
+                        case 0x18: SetSound(c, x); break;
+                        case 0x1E: AddIndex(c, x); break;
+                        case 0x29: FontCharacter(c, x); break;
+                        case 0x33: Bcd(c, x); break;
+                        case 0x55: Store(c, x); break;
+                        case 0x65: Load(c, x); break;
+                    }
+                    break;
+            }
+        }
+        return count;
+    }
+
+#ifdef CHIP8_COMPUTED_GOTO
+
+    //Threaded code: every instruction ends in its own indirect jump to the next one, which gives
+    //the branch predictor one history per instruction instead of one shared dispatch branch.
+    uint64_t Chip8::Ops::RunThreaded(Chip8& c, uint64_t count){
+        static void* const labels[16] = {
+            &&op0, &&op1nnn, &&op2nnn, &&op3xkk, &&op4xkk, &&op5xy0, &&op6xkk, &&op7xkk,
+            &&op8, &&op9xy0, &&opAnnn, &&opBnnn, &&opCxkk, &&opDxyn, &&opE, &&opF
+        };
+
+        uint64_t const total = count;
+        uint16_t opcode;
+        unsigned int x;
+        unsigned int y;
+
+        #define NEXT()                                  \
+            if (count-- == 0){ return total; }          \
+            opcode = Fetch(c, c.pc);                    \
+            x = (opcode & 0x0F00u) >> 8u;               \
+            y = (opcode & 0x00F0u) >> 4u;               \
+            c.pc += 2;                                  \
+            goto *labels[opcode >> 12u]
+
+        NEXT();
+
+        op0:
+            switch (opcode & 0x000Fu){
+                case 0x0: Cls(c); break;
+                case 0xE: Ret(c); break;
+            }
+            NEXT();
+        op1nnn:
+            Jump(c, opcode & 0x0FFFu);
+            NEXT();
+        op2nnn:
+            Call(c, opcode & 0x0FFFu);
+            NEXT();
+        op3xkk:
+            SkipIfEqual(c, x, opcode & 0x00FFu);
+            NEXT();
+        op4xkk:
+            SkipIfNotEqual(c, x, opcode & 0x00FFu);
+            NEXT();
+        op5xy0:
+            SkipIfRegistersEqual(c, x, y);
+            NEXT();
+        op6xkk:
+            Set(c, x, opcode & 0x00FFu);
+            NEXT();
+        op7xkk:
+            AddImmediate(c, x, opcode & 0x00FFu);
+            NEXT();
+        op8:
+            switch (opcode & 0x000Fu){
+                case 0x0: Move(c, x, y); break;
+                case 0x1: Or(c, x, y); break;
+                case 0x2: And(c, x, y); break;
+                case 0x3: Xor(c, x, y); break;
+                case 0x4: Add(c, x, y); break;
+                case 0x5: Sub(c, x, y); break;
+                case 0x6: ShiftRight(c, x); break;
+                case 0x7: SubReverse(c, x, y); break;
+                case 0xE: ShiftLeft(c, x); break;
+            }
+            NEXT();
+        op9xy0:
+            SkipIfRegistersNotEqual(c, x, y);
+            NEXT();
+        opAnnn:
+            SetIndex(c, opcode & 0x0FFFu);
+            NEXT();
+        opBnnn:
+            JumpOffset(c, opcode & 0x0FFFu);
+            NEXT();
+        opCxkk:
+            Random(c, x, opcode & 0x00FFu);
+            NEXT();
+        opDxyn:
+            Draw(c, x, y, opcode & 0x000Fu);
+            NEXT();
+        opE:
+            switch (opcode & 0x000Fu){
+                case 0x1: SkipIfNotKey(c, x); break;
+                case 0xE: SkipIfKey(c, x); break;
+            }
+            NEXT();
+        opF:
+            switch (opcode & 0x00FFu){
+                case 0x07: GetDelay(c, x); break;
+                case 0x0A:
+                    WaitKey(c, x);
+                    if (c.waitingForKey){
+                        return total - count - 1;
+                    }
+                    break;
+                case 0x15: SetDelay(c, x); break;
+                case 0x18: SetSound(c, x); break;
+                case 0x1E: AddIndex(c, x); break;
+                case 0x29: FontCharacter(c, x); break;
+                case 0x33: Bcd(c, x); break;
+                case 0x55: Store(c, x); break;
+                case 0x65: Load(c, x); break;
+            }
+            NEXT();
+
+        #undef NEXT
+    }
+
+#else
+
+    //Not reachable, SetDispatch() doesn't select this backend without computed goto.
+    uint64_t Chip8::Ops::RunThreaded(Chip8& c, uint64_t count){
+        return RunSwitch(c, count);
+    }
+
+#endif
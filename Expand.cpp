@@ -0,0 +1,322 @@
+#include "Expand.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define EXPAND_SSE2 1
+#define EXPAND_AVX2 1
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+#include <emmintrin.h>
+#define EXPAND_SSE2 1
+#define SSE2_TARGET
+#endif
+
+typedef void (*RowFunc)(uint64_t const* plane0, uint64_t const* plane1, unsigned int words, uint32_t const* colors, void* out);
+
+    //Palette entry (0xRRGGBBAA) to the in-memory pixel value for format.
+    static uint32_t PackColor(uint32_t color, PixelFormat format){
+        uint32_t r = color >> 24u;
+        uint32_t g = (color >> 16u) & 0xFFu;
+        uint32_t b = (color >> 8u) & 0xFFu;
+        uint32_t a = color & 0xFFu;
+
+        switch (format){
+            case PixelFormat::RGBA8888: return r | (g << 8u) | (b << 16u) | (a << 24u);
+            case PixelFormat::BGRA8888: return b | (g << 8u) | (r << 16u) | (a << 24u);
+            case PixelFormat::RGB565: return ((r >> 3u) << 11u) | ((g >> 2u) << 5u) | (b >> 3u);
+        }
+        return 0;
+    }
+
+    //Scalar fallback, also the reference for the SIMD kernels.
+    template <typename Pixel, bool TwoPlanes>
+    static void RowScalar(uint64_t const* plane0, uint64_t const* plane1, unsigned int words, uint32_t const* colors, void* out){
+        Pixel* pixels = static_cast<Pixel*>(out);
+
+        for (unsigned int w = 0; w < words; w++){
+            uint64_t bits0 = plane0[w];
+            uint64_t bits1 = TwoPlanes ? plane1[w] : 0;
+
+            for (unsigned int x = 0; x < 64; x++){
+                unsigned int shift = 63u - x;
+                unsigned int color = ((bits0 >> shift) & 1u) | (((bits1 >> shift) & 1u) << 1u);
+                pixels[w * 64 + x] = static_cast<Pixel>(colors[color]);
+            }
+        }
+    }
+
+#if defined(EXPAND_SSE2)
+    SSE2_TARGET static inline __m128i Select(__m128i mask, __m128i on, __m128i off){
+        return _mm_or_si128(_mm_and_si128(mask, on), _mm_andnot_si128(mask, off));
+    }
+
+    //4 x 32-bit pixels per step: broadcast the byte, test one bit per lane.
+    template <bool TwoPlanes>
+    SSE2_TARGET static void RowSSE2Wide(uint64_t const* plane0, uint64_t const* plane1, unsigned int words, uint32_t const* colors, void* out){
+        __m128i* pixels = static_cast<__m128i*>(out);
+        __m128i const high = _mm_setr_epi32(0x80, 0x40, 0x20, 0x10);
+        __m128i const low = _mm_setr_epi32(0x08, 0x04, 0x02, 0x01);
+        __m128i c0 = _mm_set1_epi32(static_cast<int>(colors[0]));
+        __m128i c1 = _mm_set1_epi32(static_cast<int>(colors[1]));
+        __m128i c2 = _mm_set1_epi32(static_cast<int>(colors[2]));
+        __m128i c3 = _mm_set1_epi32(static_cast<int>(colors[3]));
+
+        for (unsigned int w = 0; w < words; w++){
+            for (unsigned int byte = 0; byte < 8; byte++){
+                unsigned int shift = 56u - byte * 8u;
+                __m128i bits0 = _mm_set1_epi32(static_cast<int>((plane0[w] >> shift) & 0xFFu));
+                __m128i m0High = _mm_cmpeq_epi32(_mm_and_si128(bits0, high), high);
+                __m128i m0Low = _mm_cmpeq_epi32(_mm_and_si128(bits0, low), low);
+
+                if (TwoPlanes){
+                    __m128i bits1 = _mm_set1_epi32(static_cast<int>((plane1[w] >> shift) & 0xFFu));
+                    __m128i m1High = _mm_cmpeq_epi32(_mm_and_si128(bits1, high), high);
+                    __m128i m1Low = _mm_cmpeq_epi32(_mm_and_si128(bits1, low), low);
+                    _mm_storeu_si128(pixels++, Select(m1High, Select(m0High, c3, c2), Select(m0High, c1, c0)));
+                    _mm_storeu_si128(pixels++, Select(m1Low, Select(m0Low, c3, c2), Select(m0Low, c1, c0)));
+                }
+                else {
+                    _mm_storeu_si128(pixels++, Select(m0High, c1, c0));
+                    _mm_storeu_si128(pixels++, Select(m0Low, c1, c0));
+                }
+            }
+        }
+    }
+
+    //8 x 16-bit pixels per step.
+    template <bool TwoPlanes>
+    SSE2_TARGET static void RowSSE2Narrow(uint64_t const* plane0, uint64_t const* plane1, unsigned int words, uint32_t const* colors, void* out){
+        __m128i* pixels = static_cast<__m128i*>(out);
+        __m128i const bits = _mm_setr_epi16(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+        __m128i c0 = _mm_set1_epi16(static_cast<short>(colors[0]));
+        __m128i c1 = _mm_set1_epi16(static_cast<short>(colors[1]));
+        __m128i c2 = _mm_set1_epi16(static_cast<short>(colors[2]));
+        __m128i c3 = _mm_set1_epi16(static_cast<short>(colors[3]));
+
+        for (unsigned int w = 0; w < words; w++){
+            for (unsigned int byte = 0; byte < 8; byte++){
+                unsigned int shift = 56u - byte * 8u;
+                __m128i bits0 = _mm_set1_epi16(static_cast<short>((plane0[w] >> shift) & 0xFFu));
+                __m128i m0 = _mm_cmpeq_epi16(_mm_and_si128(bits0, bits), bits);
+
+                if (TwoPlanes){
+                    __m128i bits1 = _mm_set1_epi16(static_cast<short>((plane1[w] >> shift) & 0xFFu));
+                    __m128i m1 = _mm_cmpeq_epi16(_mm_and_si128(bits1, bits), bits);
+                    _mm_storeu_si128(pixels++, Select(m1, Select(m0, c3, c2), Select(m0, c1, c0)));
+                }
+                else {
+                    _mm_storeu_si128(pixels++, Select(m0, c1, c0));
+                }
+            }
+        }
+    }
+#endif
+
+#if defined(EXPAND_AVX2)
+    //8 x 32-bit pixels per step, one byte of the bitplane.
+    template <bool TwoPlanes>
+    AVX2_TARGET static void RowAVX2Wide(uint64_t const* plane0, uint64_t const* plane1, unsigned int words, uint32_t const* colors, void* out){
+        __m256i* pixels = static_cast<__m256i*>(out);
+        __m256i const bits = _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01);
+        __m256i c0 = _mm256_set1_epi32(static_cast<int>(colors[0]));
+        __m256i c1 = _mm256_set1_epi32(static_cast<int>(colors[1]));
+        __m256i c2 = _mm256_set1_epi32(static_cast<int>(colors[2]));
+        __m256i c3 = _mm256_set1_epi32(static_cast<int>(colors[3]));
+
+        for (unsigned int w = 0; w < words; w++){
+            for (unsigned int byte = 0; byte < 8; byte++){
+                unsigned int shift = 56u - byte * 8u;
+                __m256i bits0 = _mm256_set1_epi32(static_cast<int>((plane0[w] >> shift) & 0xFFu));
+                __m256i m0 = _mm256_cmpeq_epi32(_mm256_and_si256(bits0, bits), bits);
+
+                if (TwoPlanes){
+                    __m256i bits1 = _mm256_set1_epi32(static_cast<int>((plane1[w] >> shift) & 0xFFu));
+                    __m256i m1 = _mm256_cmpeq_epi32(_mm256_and_si256(bits1, bits), bits);
+                    __m256i off = _mm256_blendv_epi8(c0, c1, m0);
+                    __m256i on = _mm256_blendv_epi8(c2, c3, m0);
+                    _mm256_storeu_si256(pixels++, _mm256_blendv_epi8(off, on, m1));
+                }
+                else {
+                    _mm256_storeu_si256(pixels++, _mm256_blendv_epi8(c0, c1, m0));
+                }
+            }
+        }
+    }
+
+    //16 x 16-bit pixels per step, two bytes of the bitplane.
+    template <bool TwoPlanes>
+    AVX2_TARGET static void RowAVX2Narrow(uint64_t const* plane0, uint64_t const* plane1, unsigned int words, uint32_t const* colors, void* out){
+        __m256i* pixels = static_cast<__m256i*>(out);
+        __m256i const bits = _mm256_setr_epi16(
+            static_cast<short>(0x8000), 0x4000, 0x2000, 0x1000, 0x0800, 0x0400, 0x0200, 0x0100,
+            0x0080, 0x0040, 0x0020, 0x0010, 0x0008, 0x0004, 0x0002, 0x0001);
+        __m256i c0 = _mm256_set1_epi16(static_cast<short>(colors[0]));
+        __m256i c1 = _mm256_set1_epi16(static_cast<short>(colors[1]));
+        __m256i c2 = _mm256_set1_epi16(static_cast<short>(colors[2]));
+        __m256i c3 = _mm256_set1_epi16(static_cast<short>(colors[3]));
+
+        for (unsigned int w = 0; w < words; w++){
+            for (unsigned int half = 0; half < 4; half++){
+                unsigned int shift = 48u - half * 16u;
+                __m256i bits0 = _mm256_set1_epi16(static_cast<short>((plane0[w] >> shift) & 0xFFFFu));
+                __m256i m0 = _mm256_cmpeq_epi16(_mm256_and_si256(bits0, bits), bits);
+
+                if (TwoPlanes){
+                    __m256i bits1 = _mm256_set1_epi16(static_cast<short>((plane1[w] >> shift) & 0xFFFFu));
+                    __m256i m1 = _mm256_cmpeq_epi16(_mm256_and_si256(bits1, bits), bits);
+                    __m256i off = _mm256_blendv_epi8(c0, c1, m0);
+                    __m256i on = _mm256_blendv_epi8(c2, c3, m0);
+                    _mm256_storeu_si256(pixels++, _mm256_blendv_epi8(off, on, m1));
+                }
+                else {
+                    _mm256_storeu_si256(pixels++, _mm256_blendv_epi8(c0, c1, m0));
+                }
+            }
+        }
+    }
+#endif
+
+    static bool KernelSupported(ExpandKernel kernel){
+        switch (kernel){
+            case ExpandKernel::Scalar:
+                return true;
+            case ExpandKernel::SSE2:
+#if defined(EXPAND_SSE2) && defined(__GNUC__)
+                return __builtin_cpu_supports("sse2");
+#elif defined(EXPAND_SSE2)
+                return true;
+#else
+                return false;
+#endif
+            case ExpandKernel::AVX2:
+#if defined(EXPAND_AVX2)
+                return __builtin_cpu_supports("avx2");
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    static ExpandKernel DetectKernel(){
+#if defined(EXPAND_SSE2) && defined(__GNUC__)
+        //Runs from a static initializer, before the CPU model is set up by libgcc.
+        __builtin_cpu_init();
+#endif
+        if (KernelSupported(ExpandKernel::AVX2)){
+            return ExpandKernel::AVX2;
+        }
+        if (KernelSupported(ExpandKernel::SSE2)){
+            return ExpandKernel::SSE2;
+        }
+        return ExpandKernel::Scalar;
+    }
+
+    static ExpandKernel currentKernel = DetectKernel();
+
+    //Row function for the current kernel: [16/32-bit][one/two planes].
+    static RowFunc RowFor(ExpandKernel kernel, bool wide, bool twoPlanes){
+        switch (kernel){
+#if defined(EXPAND_AVX2)
+            case ExpandKernel::AVX2:
+                if (wide){
+                    return twoPlanes ? RowAVX2Wide<true> : RowAVX2Wide<false>;
+                }
+                return twoPlanes ? RowAVX2Narrow<true> : RowAVX2Narrow<false>;
+#endif
+#if defined(EXPAND_SSE2)
+            case ExpandKernel::SSE2:
+                if (wide){
+                    return twoPlanes ? RowSSE2Wide<true> : RowSSE2Wide<false>;
+                }
+                return twoPlanes ? RowSSE2Narrow<true> : RowSSE2Narrow<false>;
+#endif
+            default:
+                if (wide){
+                    return twoPlanes ? RowScalar<uint32_t, true> : RowScalar<uint32_t, false>;
+                }
+                return twoPlanes ? RowScalar<uint16_t, true> : RowScalar<uint16_t, false>;
+        }
+    }
+
+    template <typename Pixel>
+    static void ReplicatePixels(Pixel const* in, unsigned int count, unsigned int scale, uint8_t* out){
+        Pixel* pixels = reinterpret_cast<Pixel*>(out);
+
+        for (unsigned int x = 0; x < count; x++){
+            std::fill_n(pixels + x * scale, scale, in[x]);
+        }
+    }
+
+    void ExpandBitplanes(uint64_t const* plane0, uint64_t const* plane1, unsigned int width, unsigned int height,
+                         Palette const& palette, PixelFormat format, unsigned int scale, void* out, size_t pitch){
+        unsigned int words = width / 64;
+        bool wide = format != PixelFormat::RGB565;
+        size_t pixelSize = wide ? 4 : 2;
+        uint32_t colors[4];
+        uint8_t* rows = static_cast<uint8_t*>(out);
+
+        for (unsigned int i = 0; i < 4; i++){
+            colors[i] = PackColor(palette.colors[i], format);
+        }
+
+        RowFunc expandRow = RowFor(currentKernel, wide, plane1 != nullptr);
+
+        if (scale <= 1){
+            for (unsigned int y = 0; y < height; y++){
+                expandRow(plane0 + y * words, plane1 ? plane1 + y * words : nullptr, words, colors, rows + y * pitch);
+            }
+            return;
+        }
+
+        //Scaled: expand 64 pixels at a time into a small buffer, widen them into the first
+        //output row, then copy that row down scale - 1 times.
+        alignas(32) uint32_t word[64];
+        size_t rowBytes = static_cast<size_t>(width) * scale * pixelSize;
+
+        for (unsigned int y = 0; y < height; y++){
+            uint8_t* first = rows + static_cast<size_t>(y) * scale * pitch;
+
+            for (unsigned int w = 0; w < words; w++){
+                uint64_t const* bits1 = plane1 ? plane1 + y * words + w : nullptr;
+                uint8_t* dst = first + static_cast<size_t>(w) * 64 * scale * pixelSize;
+
+                expandRow(plane0 + y * words + w, bits1, 1, colors, word);
+
+                if (wide){
+                    ReplicatePixels(word, 64, scale, dst);
+                }
+                else {
+                    ReplicatePixels(reinterpret_cast<uint16_t const*>(word), 64, scale, dst);
+                }
+            }
+
+            for (unsigned int r = 1; r < scale; r++){
+                std::memcpy(first + r * pitch, first, rowBytes);
+            }
+        }
+    }
+
+    bool SetExpandKernel(ExpandKernel kernel){
+        if (!KernelSupported(kernel)){
+            return false;
+        }
+        currentKernel = kernel;
+        return true;
+    }
+
+    ExpandKernel GetExpandKernel(){
+        return currentKernel;
+    }
+
+    char const* ExpandKernelName(ExpandKernel kernel){
+        switch (kernel){
+            case ExpandKernel::Scalar: return "scalar";
+            case ExpandKernel::SSE2: return "sse2";
+            case ExpandKernel::AVX2: return "avx2";
+        }
+        return "unknown";
+    }
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//Output layouts, named by byte order in memory (little-endian hosts).
+enum class PixelFormat {
+    RGBA8888,
+    BGRA8888,
+    RGB565
+};
+
+enum class ExpandKernel {
+    Scalar,
+    SSE2,
+    AVX2
+};
+
+//Colors are 0xRRGGBBAA. One bitplane uses colors[0] (off) and colors[1] (on); two bitplanes
+//index all four with plane0 as the low bit.
+struct Palette {
+    uint32_t colors[4]{0x00000000u, 0xFFFFFFFFu, 0x00000000u, 0xFFFFFFFFu};
+};
+
+//Expands a 1-bit-per-pixel display (rows of width/64 words, bit 63 leftmost) into pixels,
+//scaling each pixel to a scale x scale block. plane1 may be null. width must be a multiple of 64.
+void ExpandBitplanes(uint64_t const* plane0, uint64_t const* plane1, unsigned int width, unsigned int height,
+                     Palette const& palette, PixelFormat format, unsigned int scale, void* out, size_t pitch);
+
+//The kernel picked at startup is the widest the CPU supports. Selecting one the CPU
+//or build does not support returns false and leaves the current kernel in place.
+bool SetExpandKernel(ExpandKernel kernel);
+ExpandKernel GetExpandKernel();
+char const* ExpandKernelName(ExpandKernel kernel);
@@ -0,0 +1,819 @@
+/*
+    Headless runner for the Chip8 core. Loads a ROM, runs it for a number of frames or instructions
+    without creating a window or GL context, and prints frame hashes and run stats.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Chip8.hpp"
+#include "Chip8Batch.hpp"
+#include "Expand.hpp"
+
+const unsigned int DEFAULT_FRAMES = 600;
+const unsigned int DEFAULT_IPF = 10;
+const unsigned int BENCH_RUNS = 5;
+const unsigned int PROFILE_TOP = 12;
+
+static void Usage(char const* name){
+    std::cerr << "Usage: " << name << " [--frames N | --instructions N] [--ipf N] [--seed N] [--wrap-x] [--wrap-y] [--trace] [--dispatch NAME] [--no-idle-skip] <ROM>\n";
+    std::cerr << "       " << name << " [--frames N] [--ipf N] [--seed N] --bench-dispatch <ROM>\n";
+    std::cerr << "       " << name << " [--frames N] [--ipf N] [--seed N] --diff --dispatch NAME <ROM>\n";
+    std::cerr << "       " << name << " [--frames N] [--ipf N] [--seed N] --diff-random COUNT --dispatch NAME\n";
+    std::cerr << "       " << name << " [--frames N] [--ipf N] [--seed N] --profile-pairs <ROM>...\n";
+    std::cerr << "       " << name << " [--frames N] [--ipf N] [--seed N] [--dispatch NAME] [--key-frames N] --bench-batch LANES <ROM>\n";
+    std::cerr << "       " << name << " [--frames N] [--ipf N] [--seed N] [--dispatch NAME] --bench-fork FORKS <ROM>\n";
+    std::cerr << "       " << name << " --bench-expand\n";
+    std::cerr << "Dispatch:";
+    for (Dispatch dispatch : ALL_DISPATCHES){
+        std::cerr << " " << DispatchName(dispatch);
+    }
+    std::cerr << "\n";
+    std::exit(EXIT_FAILURE);
+}
+
+//The value of a numeric option: all of text as a number that fits in T. Anything else, a sign
+//included, prints the usage.
+template <typename T>
+static T NumberArg(char const* name, std::string const& text){
+    size_t used = 0;
+    unsigned long long parsed = 0;
+
+    if (text.empty() || text[0] == '-' || text[0] == '+'){
+        Usage(name);
+    }
+    try {
+        parsed = std::stoull(text, &used);
+    }
+    catch (std::logic_error const&){
+        Usage(name);
+    }
+    if (used != text.size() || parsed > std::numeric_limits<T>::max()){
+        Usage(name);
+    }
+    return static_cast<T>(parsed);
+}
+
+//Bitplane to pixel expansion throughput per kernel, counted in output bytes.
+static void BenchExpand(){
+    struct Size { unsigned int width, height; };
+    Size const sizes[] = {{64, 32}, {128, 64}};
+    PixelFormat const formats[] = {PixelFormat::RGBA8888, PixelFormat::RGB565};
+    ExpandKernel const kernels[] = {ExpandKernel::Scalar, ExpandKernel::SSE2, ExpandKernel::AVX2};
+    ExpandKernel detected = GetExpandKernel();
+
+    static uint64_t planes[2][128];
+    static uint32_t pixels[128 * 64];
+    uint64_t bits = 0x9E3779B97F4A7C15ull;
+
+    for (auto& word : planes[0]){
+        bits ^= bits << 13; bits ^= bits >> 7; bits ^= bits << 17;
+        word = bits;
+    }
+
+    for (ExpandKernel kernel : kernels){
+        if (!SetExpandKernel(kernel)){
+            std::printf("expand %-6s unsupported\n", ExpandKernelName(kernel));
+            continue;
+        }
+
+        for (Size size : sizes){
+            for (PixelFormat format : formats){
+                size_t pixelSize = format == PixelFormat::RGB565 ? 2 : 4;
+                size_t frameBytes = size.width * size.height * pixelSize;
+                uint64_t frames = 0;
+                double elapsed = 0.0;
+                auto start = std::chrono::steady_clock::now();
+
+                while (elapsed < 0.2){
+                    for (int i = 0; i < 1000; i++){
+                        ExpandBitplanes(planes[0], nullptr, size.width, size.height, Palette{}, format, 1, pixels, size.width * pixelSize);
+                    }
+                    frames += 1000;
+                    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+
+                std::printf("expand %-6s %3ux%-3u %-8s %7.2f GB/s %8.1f ns/frame\n", ExpandKernelName(kernel), size.width, size.height,
+                            format == PixelFormat::RGB565 ? "rgb565" : "rgba8888", frames * frameBytes / elapsed / 1e9, elapsed * 1e9 / frames);
+            }
+        }
+    }
+
+    SetExpandKernel(detected);
+}
+
+//Runs the ROM under every dispatch backend, best of BENCH_RUNS. All of them must end on the same frame.
+//Idle loops run like any other code, they're part of what's being measured.
+static int BenchDispatch(char const* romFilename, uint64_t frames, uint64_t instructionsPerFrame, uint32_t seed, Quirks quirks){
+    uint64_t expectedHash = 0;
+    bool mismatch = false;
+
+    for (Dispatch dispatch : ALL_DISPATCHES){
+        double best = 0.0;
+        uint64_t hash = 0;
+
+        for (unsigned int run = 0; run < BENCH_RUNS; run++){
+            Chip8 chip8(seed);
+            chip8.SetQuirks(quirks);
+            chip8.SetIdleSkip(false);
+
+            if (!chip8.LoadROM(romFilename)){
+                std::cerr << "Could not load ROM " << romFilename << "\n";
+                return EXIT_FAILURE;
+            }
+            if (chip8.SetDispatch(dispatch) != dispatch){
+                break;
+            }
+
+            uint64_t retired = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t frame = 0; frame < frames; frame++){
+                retired += chip8.RunUntilFrameEnd(instructionsPerFrame).instructions;
+            }
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            best = std::max(best, elapsed > 0 ? retired / elapsed : 0.0);
+            hash = chip8.FrameHash();
+        }
+
+        if (best == 0.0){
+            std::printf("dispatch %-14s unsupported\n", DispatchName(dispatch));
+            continue;
+        }
+        if (dispatch == ALL_DISPATCHES[0]){
+            expectedHash = hash;
+        }
+
+        std::printf("dispatch %-14s %8.1f Mips hash=%016llx%s\n", DispatchName(dispatch), best / 1e6,
+                    (unsigned long long)hash, hash == expectedHash ? "" : " MISMATCH");
+        mismatch |= hash != expectedHash;
+    }
+
+    return mismatch ? EXIT_FAILURE : 0;
+}
+
+//Pseudo-random keypad for a frame: each key is held for the whole frame with probability 1/4.
+//Bit n for key n.
+static uint16_t RandomKeys(uint64_t& state){
+    uint16_t held = 0;
+    state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+
+    for (unsigned int key = 0; key < KEY_COUNT; key++){
+        held |= static_cast<uint16_t>((((state >> (2 * key)) & 3u) == 0) << key);
+    }
+    return held;
+}
+
+static void PressRandomKeys(uint64_t& state, Chip8& chip8){
+    uint16_t held = RandomKeys(state);
+
+    for (unsigned int key = 0; key < KEY_COUNT; key++){
+        chip8.keypad[key] = (held >> key) & 1u;
+    }
+}
+
+//Instruction class of an opcode, named the way the handlers are.
+static char const* Mnemonic(uint16_t opcode){
+    static char const* const low[16] = {"1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk", "8xy?", "9xy0", "Annn", "Bnnn", "Cxkk", "Dxyn", "Ex??", "Fx??"};
+    static char const* const alu[16] = {"8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xy?", "8xy?", "8xy?", "8xy?", "8xy?", "8xy?", "8xyE", "8xy?"};
+
+    switch (opcode >> 12u){
+        case 0x0:
+            return opcode == 0x00E0 ? "00E0" : opcode == 0x00EE ? "00EE" : "0nnn";
+        case 0x8:
+            return alu[opcode & 0x000Fu];
+        case 0xE:
+            return (opcode & 0x00FFu) == 0x9E ? "Ex9E" : (opcode & 0x00FFu) == 0xA1 ? "ExA1" : "Ex??";
+        case 0xF:
+            switch (opcode & 0x00FFu){
+                case 0x07: return "Fx07";
+                case 0x0A: return "Fx0A";
+                case 0x15: return "Fx15";
+                case 0x18: return "Fx18";
+                case 0x1E: return "Fx1E";
+                case 0x29: return "Fx29";
+                case 0x33: return "Fx33";
+                case 0x55: return "Fx55";
+                case 0x65: return "Fx65";
+            }
+            return "Fx??";
+    }
+    return low[(opcode >> 12u) - 1];
+}
+
+//Counts how often instruction classes run back to back at consecutive addresses, the sequences a
+//superinstruction could replace. Every ROM gets the same frames and key presses.
+static int ProfilePairs(std::vector<char const*> const& roms, uint64_t frames, uint64_t instructionsPerFrame, uint32_t seed, Quirks quirks){
+    std::map<std::string, uint64_t> pairs;
+    std::map<std::string, uint64_t> triples;
+    uint64_t total = 0;
+
+    for (char const* romFilename : roms){
+        Chip8 chip8(seed);
+        chip8.SetQuirks(quirks);
+
+        if (!chip8.LoadROM(romFilename)){
+            std::cerr << "Could not load ROM " << romFilename << "\n";
+            return EXIT_FAILURE;
+        }
+
+        uint64_t keys = 0x2545F4914F6CDD1Dull ^ seed;
+        std::string previous[2];
+        unsigned int run = 0;
+        unsigned int expected = ~0u;
+
+        for (uint64_t frame = 0; frame < frames; frame++){
+            PressRandomKeys(keys, chip8);
+
+            for (uint64_t i = 0; i < instructionsPerFrame; i++){
+                unsigned int address = chip8.PC();
+                std::string name = Mnemonic(chip8.InstructionAt(address));
+
+                //Blocked in Fx0A, nothing more runs this frame.
+                if (chip8.Cycle() == 0){
+                    break;
+                }
+                total++;
+
+                //A taken jump, call or skip starts a new sequence.
+                run = address == expected ? run + 1 : 1;
+                if (run >= 2){
+                    pairs[previous[1] + " " + name]++;
+                }
+                if (run >= 3){
+                    triples[previous[0] + " " + previous[1] + " " + name]++;
+                }
+
+                previous[0] = previous[1];
+                previous[1] = name;
+                expected = address + 2;
+            }
+            total += chip8.RunUntilFrameEnd(instructionsPerFrame).instructions;
+        }
+    }
+
+    for (auto const* counts : {&pairs, &triples}){
+        std::vector<std::pair<uint64_t, std::string>> sorted;
+        for (auto const& entry : *counts){
+            sorted.emplace_back(entry.second, entry.first);
+        }
+        std::sort(sorted.rbegin(), sorted.rend());
+
+        for (size_t i = 0; i < std::min<size_t>(sorted.size(), PROFILE_TOP); i++){
+            std::printf("%-6s %-16s %12llu %6.2f%%\n", counts == &pairs ? "pair" : "triple", sorted[i].second.c_str(),
+                        (unsigned long long)sorted[i].first, 100.0 * sorted[i].first / total);
+        }
+    }
+    return 0;
+}
+
+//Runs the ROM under the given backend and under the tables side by side, pressing random keys,
+//and compares the whole machine state after every frame. Only the backend skips idle loops.
+//Prints the outcome after label, false unless every frame matched.
+static bool DiffFrames(char const* name, char const* label, uint8_t const* rom, size_t size, Dispatch dispatch, uint64_t frames, uint64_t instructionsPerFrame, uint32_t seed, Quirks quirks){
+    Chip8 reference(seed);
+    Chip8 candidate(seed);
+    reference.SetQuirks(quirks);
+    reference.SetIdleSkip(false);
+    candidate.SetQuirks(quirks);
+    if (!reference.LoadROM(rom, size) || !candidate.LoadROM(rom, size)){
+        std::cerr << "Could not load ROM " << name << "\n";
+        return false;
+    }
+    if (candidate.SetDispatch(dispatch) != dispatch){
+        std::printf("%s%s unsupported\n", label, DispatchName(dispatch));
+        return false;
+    }
+    //Without a translation linked in for this ROM, aot is the tables and would match trivially.
+    if (dispatch == Dispatch::Aot && !candidate.HasAot()){
+        std::printf("%s%s no translation of %s linked in\n", label, DispatchName(dispatch), name);
+        return false;
+    }
+
+    uint64_t keys = 0x2545F4914F6CDD1Dull ^ seed;
+
+    for (uint64_t frame = 0; frame < frames; frame++){
+        PressRandomKeys(keys, reference);
+        std::copy(reference.keypad, reference.keypad + KEY_COUNT, candidate.keypad);
+
+        reference.RunUntilFrameEnd(instructionsPerFrame);
+        candidate.RunUntilFrameEnd(instructionsPerFrame);
+
+        if (reference.StateHash() != candidate.StateHash()){
+            std::printf("%s%s diverged at frame %llu pc=%03x expected pc=%03x\n", label, DispatchName(dispatch),
+                        (unsigned long long)frame, candidate.PC(), reference.PC());
+            return false;
+        }
+    }
+
+    std::printf("%s%s matched %llu frames state=%016llx\n", label, DispatchName(dispatch),
+                (unsigned long long)frames, (unsigned long long)candidate.StateHash());
+    return true;
+}
+
+static int DiffDispatch(char const* romFilename, Dispatch dispatch, uint64_t frames, uint64_t instructionsPerFrame, uint32_t seed, Quirks quirks){
+    std::ifstream file(romFilename, std::ios::binary);
+
+    if (!file.is_open()){
+        std::cerr << "Could not load ROM " << romFilename << "\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return DiffFrames(romFilename, "diff ", rom.data(), rom.size(), dispatch, frames, instructionsPerFrame, seed, quirks) ? 0 : EXIT_FAILURE;
+}
+
+//A ROM of random but mostly well-formed instructions, weighted towards the control flow the
+//caching backends have to get right: calls, returns and skips into the middle of code, Bnnn,
+//and jumps to the last words of memory, from where pc runs off the end.
+static std::vector<uint8_t> RandomRom(uint64_t& state){
+    auto next = [&state](uint32_t range){
+        state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+        return static_cast<uint32_t>((state >> 16) % range);
+    };
+    static uint8_t const alu[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+    static uint8_t const misc[] = {0x07, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65};
+    uint32_t words = 16 + next(1776);
+    std::vector<uint8_t> rom;
+
+    for (uint32_t i = 0; i < words; i++){
+        uint32_t kind = next(100);
+        uint32_t x = next(16) << 8u;
+        uint32_t y = next(16) << 4u;
+        uint32_t kk = next(256);
+        uint32_t code = 0x200 + 2 * next(words);
+        uint32_t nearEnd = MEMORY_SIZE - 2 * (1 + next(4));
+        uint32_t opcode;
+
+        if (kind < 3)       opcode = 0x00E0;
+        else if (kind < 5)  opcode = 0x00EE;
+        else if (kind < 10) opcode = 0x1000 | (next(2) ? code : nearEnd);
+        else if (kind < 14) opcode = 0x2000 | code;
+        else if (kind < 20) opcode = 0x3000 | x | kk;
+        else if (kind < 25) opcode = 0x4000 | x | kk;
+        else if (kind < 28) opcode = 0x5000 | x | y;
+        else if (kind < 38) opcode = 0x6000 | x | kk;
+        else if (kind < 48) opcode = 0x7000 | x | kk;
+        else if (kind < 60) opcode = 0x8000 | x | y | alu[next(sizeof(alu))];
+        else if (kind < 62) opcode = 0x9000 | x | y;
+        else if (kind < 67) opcode = 0xA000 | next(MEMORY_SIZE);
+        else if (kind < 71) opcode = 0xB000 | (next(2) ? code : MEMORY_SIZE - 1 - next(256));
+        else if (kind < 75) opcode = 0xC000 | x | kk;
+        else if (kind < 80) opcode = 0xD000 | x | y | next(16);
+        else if (kind < 83) opcode = 0xE000 | x | (next(2) ? 0x9E : 0xA1);
+        else                opcode = 0xF000 | x | misc[next(sizeof(misc))];
+
+        rom.push_back(static_cast<uint8_t>(opcode >> 8u));
+        rom.push_back(static_cast<uint8_t>(opcode & 0xFFu));
+    }
+    return rom;
+}
+
+//--diff over count random ROMs.
+static int DiffRandom(unsigned int count, Dispatch dispatch, uint64_t frames, uint64_t instructionsPerFrame, uint32_t seed, Quirks quirks){
+    uint64_t state = 0x9E3779B97F4A7C15ull ^ seed;
+    unsigned int diverged = 0;
+
+    //Generated ROMs are never translated, there's no aot code to compare.
+    if (dispatch == Dispatch::Aot){
+        std::printf("random %s unsupported\n", DispatchName(dispatch));
+        return EXIT_FAILURE;
+    }
+
+    for (unsigned int i = 0; i < count; i++){
+        std::vector<uint8_t> rom = RandomRom(state);
+        std::string label = "random " + std::to_string(i) + " ";
+
+        if (!DiffFrames(label.c_str(), label.c_str(), rom.data(), rom.size(), dispatch, frames, instructionsPerFrame, seed, quirks)){
+            if (Chip8(seed).SetDispatch(dispatch) != dispatch){
+                return EXIT_FAILURE;
+            }
+            diverged++;
+        }
+    }
+
+    std::printf("random %s %u of %u ROMs diverged\n", DispatchName(dispatch), diverged, count);
+    return diverged ? EXIT_FAILURE : 0;
+}
+
+//Runs lanes copies of the ROM in a Chip8Batch, each lane with its own random keys, and the same
+//lanes one after another as separate Chip8s on each baseline backend that this build and ROM
+//support. Every lane has to end each frame in the same place as its Chip8s. Keys are held for
+//keyFrames frames at a time. The batch is reported against the fastest baseline.
+static int BenchBatch(char const* romFilename, unsigned int lanes, uint64_t keyFrames, std::vector<Dispatch> const& baselines, uint64_t frames, uint64_t instructionsPerFrame, uint32_t seed, Quirks quirks){
+    struct Baseline {
+        Dispatch dispatch;
+        std::vector<std::unique_ptr<Chip8>> chips;
+        double time;
+        uint64_t retired;
+    };
+
+    Chip8Batch batch(lanes, seed);
+    std::vector<Baseline> scalars;
+    std::vector<uint64_t> keys(lanes);
+    std::vector<uint16_t> held(lanes);
+    BatchStats total;
+    double batchTime = 0.0;
+
+    batch.SetQuirks(quirks);
+    if (!batch.LoadROM(romFilename)){
+        std::cerr << "Could not load ROM " << romFilename << "\n";
+        return EXIT_FAILURE;
+    }
+
+    for (Dispatch dispatch : baselines){
+        Baseline scalar{dispatch, {}, 0.0, 0};
+
+        for (unsigned int lane = 0; lane < lanes; lane++){
+            scalar.chips.emplace_back(new Chip8(seed));
+            scalar.chips[lane]->SetQuirks(quirks);
+            scalar.chips[lane]->SetIdleSkip(false);
+            scalar.chips[lane]->LoadROM(romFilename);
+        }
+
+        //Aot without a translation of this ROM is the tables again.
+        Chip8& first = *scalar.chips[0];
+        if (first.SetDispatch(dispatch) != dispatch || (dispatch == Dispatch::Aot && !first.HasAot())){
+            continue;
+        }
+        for (auto const& chip : scalar.chips){
+            chip->SetDispatch(dispatch);
+        }
+        scalars.push_back(std::move(scalar));
+    }
+    if (scalars.empty()){
+        std::printf("batch no baseline backend supported\n");
+        return EXIT_FAILURE;
+    }
+
+    for (unsigned int lane = 0; lane < lanes; lane++){
+        keys[lane] = 0x2545F4914F6CDD1Dull ^ seed ^ (lane * 0x9E3779B97F4A7C15ull);
+    }
+
+    for (uint64_t frame = 0; frame < frames; frame++){
+        for (unsigned int lane = 0; lane < lanes; lane++){
+            if (frame % keyFrames == 0){
+                held[lane] = RandomKeys(keys[lane]);
+            }
+            batch.SetKeys(lane, held[lane]);
+            for (Baseline& scalar : scalars){
+                for (unsigned int key = 0; key < KEY_COUNT; key++){
+                    scalar.chips[lane]->keypad[key] = (held[lane] >> key) & 1u;
+                }
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        BatchStats stats = batch.RunFrame(instructionsPerFrame);
+        batchTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        for (Baseline& scalar : scalars){
+            auto middle = std::chrono::steady_clock::now();
+            for (unsigned int lane = 0; lane < lanes; lane++){
+                scalar.retired += scalar.chips[lane]->RunUntilFrameEnd(instructionsPerFrame).instructions;
+            }
+            scalar.time += std::chrono::duration<double>(std::chrono::steady_clock::now() - middle).count();
+        }
+
+        total.instructions += stats.instructions;
+        total.steps += stats.steps;
+        total.vectorSteps += stats.vectorSteps;
+        total.scalarLanes += stats.scalarLanes;
+
+        for (Baseline const& scalar : scalars){
+            for (unsigned int lane = 0; lane < lanes; lane++){
+                Chip8 const& chip8 = *scalar.chips[lane];
+                bool same = batch.PC(lane) == chip8.PC() && batch.Index(lane) == chip8.Index() && batch.FrameHash(lane) == chip8.FrameHash();
+
+                for (unsigned int i = 0; i < REGISTER_COUNT; i++){
+                    same &= batch.Register(lane, i) == chip8.Register(i);
+                }
+                if (!same){
+                    std::printf("batch lane %u diverged from %s at frame %llu pc=%03x expected pc=%03x\n", lane, DispatchName(scalar.dispatch),
+                                (unsigned long long)frame, batch.PC(lane), chip8.PC());
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+    }
+
+    auto Mips = [](uint64_t instructions, double time){ return time > 0 ? instructions / time / 1e6 : 0.0; };
+    Baseline const* best = &scalars[0];
+
+    std::printf("batch lanes=%u frames=%llu instructions=%llu\n", lanes, (unsigned long long)frames, (unsigned long long)total.instructions);
+    std::printf("batch steps=%llu vector_steps=%llu scalar_lane_instructions=%llu\n", (unsigned long long)total.steps,
+                (unsigned long long)total.vectorSteps, (unsigned long long)total.scalarLanes);
+    std::printf("batch lane_utilization=%.3f\n", total.Utilization(lanes));
+    for (Baseline const& scalar : scalars){
+        std::printf("batch baseline %-14s %8.1f Mips one lane at a time\n", DispatchName(scalar.dispatch), Mips(scalar.retired, scalar.time));
+        if (Mips(scalar.retired, scalar.time) > Mips(best->retired, best->time)){
+            best = &scalar;
+        }
+    }
+    std::printf("batch %.1f Mips, fastest baseline %s one lane at a time %.1f Mips, all lanes matched\n",
+                Mips(total.instructions, batchTime), DispatchName(best->dispatch), Mips(best->retired, best->time));
+    return 0;
+}
+
+//Forks one machine the way a tree search expands a node. The root runs frames frames on random
+//keys, then is forked forks times and every fork runs one more frame on keys of its own. Checks
+//that a fork carries on exactly like the machine it came from and that nothing it does leaks
+//back into the root, then reports forks per second and the memory each live fork holds.
+static int BenchFork(char const* romFilename, unsigned int forks, Dispatch dispatch, uint64_t frames, uint64_t instructionsPerFrame, uint32_t seed, Quirks quirks){
+    const uint64_t CHECK_FRAMES = 60;
+    Chip8 root(seed);
+    uint64_t keys = 0x2545F4914F6CDD1Dull ^ seed;
+
+    root.SetQuirks(quirks);
+    root.SetDispatch(dispatch);
+    if (!root.LoadROM(romFilename)){
+        std::cerr << "Could not load ROM " << romFilename << "\n";
+        return EXIT_FAILURE;
+    }
+
+    for (uint64_t frame = 0; frame < frames; frame++){
+        PressRandomKeys(keys, root);
+        root.RunUntilFrameEnd(instructionsPerFrame);
+    }
+
+    //A fork of a fork, each run on the same keys, have to agree frame by frame with the root
+    //left as it was.
+    uint64_t rootHash = root.StateHash();
+    std::unique_ptr<Chip8> first = root.Fork();
+    std::unique_ptr<Chip8> second = first->Fork();
+    uint64_t firstKeys = keys;
+    uint64_t secondKeys = keys;
+
+    for (uint64_t frame = 0; frame < CHECK_FRAMES; frame++){
+        PressRandomKeys(firstKeys, *first);
+        first->RunUntilFrameEnd(instructionsPerFrame);
+        PressRandomKeys(secondKeys, *second);
+        second->RunUntilFrameEnd(instructionsPerFrame);
+
+        if (first->StateHash() != second->StateHash()){
+            std::printf("fork diverged from its parent at frame %llu\n", (unsigned long long)frame);
+            return EXIT_FAILURE;
+        }
+    }
+    if (root.StateHash() != rootHash){
+        std::printf("running a fork changed the root\n");
+        return EXIT_FAILURE;
+    }
+    first.reset();
+    second.reset();
+
+    std::vector<std::unique_ptr<Chip8>> children;
+    children.reserve(forks);
+    size_t forkedBytes = 0;
+    size_t ranBytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < forks; i++){
+        children.push_back(root.Fork());
+    }
+    auto forked = std::chrono::steady_clock::now();
+
+    for (auto const& child : children){
+        forkedBytes += child->Footprint();
+    }
+
+    auto running = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < forks; i++){
+        uint64_t childKeys = keys ^ (i * 0x9E3779B97F4A7C15ull);
+        PressRandomKeys(childKeys, *children[i]);
+        children[i]->RunUntilFrameEnd(instructionsPerFrame);
+    }
+    auto ran = std::chrono::steady_clock::now();
+
+    for (auto const& child : children){
+        ranBytes += child->Footprint();
+    }
+
+    auto freeing = std::chrono::steady_clock::now();
+    children.clear();
+    auto freed = std::chrono::steady_clock::now();
+
+    double forkTime = std::chrono::duration<double>(forked - start).count();
+    double runTime = std::chrono::duration<double>(ran - running).count();
+    double freeTime = std::chrono::duration<double>(freed - freeing).count();
+    //Same ROM, so it only has the pages the ROM and fontset were written to.
+    Chip8 alone(seed);
+    alone.LoadROM(romFilename);
+
+    std::printf("fork forks=%u frames=%llu ipf=%llu dispatch=%s\n", forks, (unsigned long long)frames,
+                (unsigned long long)instructionsPerFrame, DispatchName(root.GetDispatch()));
+    std::printf("fork %.2f M forks/s, %.2f M frees/s, %.3f M fork frames/s\n", forkTime > 0 ? forks / forkTime / 1e6 : 0.0,
+                freeTime > 0 ? forks / freeTime / 1e6 : 0.0, runTime > 0 ? forks / runTime / 1e6 : 0.0);
+    std::printf("fork bytes per live fork: %zu forked, %zu after a frame, %zu for a machine of its own\n",
+                forks ? forkedBytes / forks : 0, forks ? ranBytes / forks : 0, alone.Footprint());
+    std::printf("fork matched %llu frames against a fork of itself, root unchanged\n", (unsigned long long)CHECK_FRAMES);
+    return 0;
+}
+
+int main(int argc, char** argv){
+    auto startTime = std::chrono::steady_clock::now();
+
+    uint64_t frames = DEFAULT_FRAMES;
+    uint64_t instructions = 0;
+    uint64_t instructionsPerFrame = DEFAULT_IPF;
+    uint32_t seed = 0;
+    bool trace = false;
+    bool idleSkip = true;
+    bool benchDispatch = false;
+    bool diff = false;
+    bool profilePairs = false;
+    unsigned int batchLanes = 0;
+    unsigned int forks = 0;
+    unsigned int randomRoms = 0;
+    uint64_t keyFrames = 1;
+    std::vector<char const*> roms;
+    Dispatch dispatch = Dispatch::CHIP8_DEFAULT_DISPATCH;
+    bool dispatchSet = false;
+    Quirks quirks;
+    char const* romFilename = nullptr;
+
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+
+        if (arg == "--bench-expand"){
+            BenchExpand();
+            return 0;
+        }
+        else if (arg == "--bench-dispatch"){
+            benchDispatch = true;
+        }
+        else if (arg == "--profile-pairs"){
+            profilePairs = true;
+        }
+        else if (i + 1 < argc && arg == "--bench-batch"){
+            batchLanes = NumberArg<unsigned int>(argv[0], argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--bench-fork"){
+            forks = NumberArg<unsigned int>(argv[0], argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--key-frames"){
+            keyFrames = std::max<uint64_t>(1, NumberArg<uint64_t>(argv[0], argv[++i]));
+        }
+        else if (i + 1 < argc && arg == "--diff-random"){
+            randomRoms = NumberArg<unsigned int>(argv[0], argv[++i]);
+        }
+        else if (arg == "--diff"){
+            diff = true;
+        }
+        else if (i + 1 < argc && arg == "--dispatch"){
+            if (!ParseDispatch(argv[++i], dispatch)){
+                Usage(argv[0]);
+            }
+            dispatchSet = true;
+        }
+        else if (arg == "--no-idle-skip"){
+            idleSkip = false;
+        }
+        else if (arg == "--trace"){
+            trace = true;
+        }
+        else if (arg == "--wrap-x"){
+            quirks.horizontal = EdgeMode::Wrap;
+        }
+        else if (arg == "--wrap-y"){
+            quirks.vertical = EdgeMode::Wrap;
+        }
+        else if (i + 1 < argc && arg == "--frames"){
+            frames = NumberArg<uint64_t>(argv[0], argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--instructions"){
+            instructions = NumberArg<uint64_t>(argv[0], argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--ipf"){
+            instructionsPerFrame = NumberArg<uint64_t>(argv[0], argv[++i]);
+        }
+        else if (i + 1 < argc && arg == "--seed"){
+            seed = NumberArg<uint32_t>(argv[0], argv[++i]);
+        }
+        else if ((!romFilename || profilePairs) && arg[0] != '-'){
+            romFilename = argv[i];
+            roms.push_back(argv[i]);
+        }
+        else {
+            Usage(argv[0]);
+        }
+    }
+
+    if (randomRoms > 0 && instructionsPerFrame > 0){
+        return DiffRandom(randomRoms, dispatch, frames, instructionsPerFrame, seed, quirks);
+    }
+    if (!romFilename || instructionsPerFrame == 0){
+        Usage(argv[0]);
+    }
+
+    if (benchDispatch){
+        return BenchDispatch(romFilename, frames, instructionsPerFrame, seed, quirks);
+    }
+    if (batchLanes > 0){
+        //Without --dispatch the batch is measured against every backend there is.
+        std::vector<Dispatch> baselines(std::begin(ALL_DISPATCHES), std::end(ALL_DISPATCHES));
+        if (dispatchSet){
+            baselines.assign(1, dispatch);
+        }
+        return BenchBatch(romFilename, batchLanes, keyFrames, baselines, frames, instructionsPerFrame, seed, quirks);
+    }
+    if (forks > 0){
+        return BenchFork(romFilename, forks, dispatch, frames, instructionsPerFrame, seed, quirks);
+    }
+    if (profilePairs){
+        return ProfilePairs(roms, frames, instructionsPerFrame, seed, quirks);
+    }
+    if (diff){
+        return DiffDispatch(romFilename, dispatch, frames, instructionsPerFrame, seed, quirks);
+    }
+
+    Chip8 chip8(seed);
+    chip8.SetQuirks(quirks);
+    chip8.SetIdleSkip(idleSkip);
+    dispatch = chip8.SetDispatch(dispatch);
+
+    if (!chip8.LoadROM(romFilename)){
+        std::cerr << "Could not load ROM " << romFilename << "\n";
+        return EXIT_FAILURE;
+    }
+
+    //An instruction count overrides the frame count, the last frame may be partial.
+    if (instructions > 0){
+        frames = (instructions + instructionsPerFrame - 1) / instructionsPerFrame;
+    }
+    else {
+        instructions = frames * instructionsPerFrame;
+    }
+
+    auto runTime = std::chrono::steady_clock::now();
+    uint64_t retired = 0;
+    uint64_t changedFrames = 0;
+    uint64_t skippedFrames = 0;
+    uint64_t idleSkipped = 0;
+    Idle idle = Idle::None;
+
+    uint64_t frame = 0;
+
+    for (; frame < frames; frame++){
+        RunStats stats;
+
+        if (instructions - retired >= instructionsPerFrame){
+            stats = chip8.RunUntilFrameEnd(instructionsPerFrame);
+        }
+        else {
+            stats = chip8.RunCycles(instructions - retired);
+        }
+
+        retired += stats.instructions;
+        changedFrames += stats.displayChanged;
+        idleSkipped += stats.skipped;
+        idle = stats.idle;
+
+        //Same test the frontend uses to skip uploading and presenting a frame.
+        if (chip8.Dirty().Empty()){
+            skippedFrames++;
+        }
+        chip8.ClearDirty();
+
+        if (trace){
+            std::printf("frame %llu %016llx\n", (unsigned long long)frame, (unsigned long long)chip8.FrameHash());
+        }
+
+        //Nothing can happen until a key is pressed, and nothing here presses one.
+        if (idle == Idle::WaitKey){
+            frame++;
+            break;
+        }
+    }
+
+    auto endTime = std::chrono::steady_clock::now();
+    double startup = std::chrono::duration<double, std::micro>(runTime - startTime).count();
+    double elapsed = std::chrono::duration<double>(endTime - runTime).count();
+
+    std::printf("rom=%s\n", romFilename);
+    std::printf("dispatch=%s\n", DispatchName(dispatch));
+    std::printf("frames=%llu\n", (unsigned long long)frame);
+    std::printf("instructions=%llu\n", (unsigned long long)retired);
+    std::printf("changed_frames=%llu\n", (unsigned long long)changedFrames);
+    std::printf("present_skip_ratio=%.3f\n", frame ? (double)skippedFrames / frame : 0.0);
+    std::printf("hash=%016llx\n", (unsigned long long)chip8.FrameHash());
+    std::printf("idle_skipped=%llu\n", (unsigned long long)idleSkipped);
+    std::printf("halt=%s\n", IdleName(idle));
+    std::printf("startup_us=%.1f\n", startup);
+    std::printf("elapsed_s=%.6f\n", elapsed);
+    std::printf("ips=%.0f\n", elapsed > 0 ? retired / elapsed : 0.0);
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include <algorithm>
+#include <cstdint>
+
+//Idle loop detection. Within one call to a Run* entry point the timers and keypad can't change,
+//so a loop that only reads them and touches nothing but registers, I and pc runs the same way
+//every time round once it has been round once. Such a loop is stepped through on the side
+//twice, and if the second pass changes nothing the rest of the budget is worked out instead of run.
+
+//Longest loop looked for, in instructions.
+const unsigned int MAX_IDLE_LOOP = 32;
+
+namespace {
+
+    struct LoopState {
+        uint8_t registers[REGISTER_COUNT];
+        uint16_t index;
+        uint16_t pc;
+    };
+
+    enum : unsigned int {
+        READS_TIMER = 1,
+        READS_KEYS = 2
+    };
+
+    bool operator==(LoopState const& a, LoopState const& b){
+        for (unsigned int i = 0; i < REGISTER_COUNT; i++){
+            if (a.registers[i] != b.registers[i]){
+                return false;
+            }
+        }
+        return a.index == b.index && a.pc == b.pc;
+    }
+
+    //One instruction, same semantics as Chip8::Ops. False for anything that does more than
+    //read registers, I, pc, the keypad and the delay timer and write registers, I and pc.
+    bool LoopStep(Chip8 const& c, uint8_t delay, LoopState& s, unsigned int& reads){
+        uint16_t opcode = Chip8::Ops::Fetch(c, s.pc);
+        unsigned int x = (opcode & 0x0F00u) >> 8u;
+        unsigned int y = (opcode & 0x00F0u) >> 4u;
+        uint8_t kk = opcode & 0x00FFu;
+
+        s.pc += 2;
+
+        switch (opcode >> 12u){
+            case 0x1: s.pc = opcode & 0x0FFFu; return true;
+            case 0x3: s.pc += s.registers[x] == kk ? 2 : 0; return true;
+            case 0x4: s.pc += s.registers[x] != kk ? 2 : 0; return true;
+            case 0x5: s.pc += s.registers[x] == s.registers[y] ? 2 : 0; return true;
+            case 0x9: s.pc += s.registers[x] != s.registers[y] ? 2 : 0; return true;
+            case 0x6: s.registers[x] = kk; return true;
+            case 0x7: s.registers[x] += kk; return true;
+            case 0x8:
+                switch (opcode & 0x000Fu){
+                    case 0x0: s.registers[x] = s.registers[y]; return true;
+                    case 0x1: s.registers[x] |= s.registers[y]; return true;
+                    case 0x2: s.registers[x] &= s.registers[y]; return true;
+                    case 0x3: s.registers[x] ^= s.registers[y]; return true;
+                }
+                return false;
+            case 0xA: s.index = opcode & 0x0FFFu; return true;
+            case 0xE: {
+                bool down = c.keypad[s.registers[x] & (KEY_COUNT - 1)] != 0;
+                reads |= READS_KEYS;
+
+                switch (opcode & 0x000Fu){
+                    case 0x1: s.pc += down ? 0 : 2; return true;
+                    case 0xE: s.pc += down ? 2 : 0; return true;
+                }
+                return false;
+            }
+            case 0xF:
+                if (kk == 0x07){
+                    s.registers[x] = delay;
+                    reads |= READS_TIMER;
+                    return true;
+                }
+                return false;
+        }
+        return false;
+    }
+
+    //Steps until pc is back where it started. Returns the instructions that took, 0 if it didn't
+    //get back within MAX_IDLE_LOOP or ran into something LoopStep() can't do.
+    unsigned int RunLoop(Chip8 const& c, uint8_t delay, LoopState& s, unsigned int& reads){
+        uint16_t start = s.pc;
+
+        for (unsigned int length = 1; length <= MAX_IDLE_LOOP; length++){
+            if (!LoopStep(c, delay, s, reads)){
+                return 0;
+            }
+            if (s.pc == start){
+                return length;
+            }
+        }
+        return 0;
+    }
+
+}
+
+    //Fast-forwards count instructions if pc is in an idle loop. Exact: registers, I and pc end
+    //up where running the loop would have left them.
+    Idle Chip8::Ops::SkipIdle(Chip8& c, uint64_t count){
+        LoopState s;
+        std::copy(c.registers, c.registers + REGISTER_COUNT, s.registers);
+        s.index = c.index;
+        s.pc = c.pc;
+
+        //The first time round can still differ, e.g. Vx holds something else until Fx07 runs.
+        unsigned int reads = 0;
+        uint8_t delay = c.DelayTimer();
+        unsigned int first = RunLoop(c, delay, s, reads);
+        LoopState settled = s;
+        unsigned int length = first ? RunLoop(c, delay, s, reads) : 0;
+
+        if (length == 0 || !(s == settled) || count < first + length){
+            return Idle::None;
+        }
+
+        uint64_t rest = (count - first) % length;
+        s = settled;
+        for (uint64_t i = 0; i < rest; i++){
+            LoopStep(c, delay, s, reads);
+        }
+
+        std::copy(s.registers, s.registers + REGISTER_COUNT, c.registers);
+        c.index = s.index;
+        c.pc = s.pc;
+
+        if (reads & READS_TIMER){
+            return Idle::DelayWait;
+        }
+        return reads & READS_KEYS ? Idle::KeyPoll : Idle::Halted;
+    }
+
+    char const* IdleName(Idle idle){
+        switch (idle){
+            case Idle::None: return "none";
+            case Idle::Halted: return "halted";
+            case Idle::DelayWait: return "delay-wait";
+            case Idle::KeyPoll: return "key-poll";
+            case Idle::WaitKey: return "blocked-on-input";
+        }
+        return "unknown";
+    }
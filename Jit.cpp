@@ -0,0 +1,400 @@
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef CHIP8_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//Jit backend: x86-64 code for the blocks recorded by the Blocks backend (Block.cpp), which
+//also does the lookup, recording, invalidation and budget handling. Arithmetic, loads and all
+//the skips run natively; anything touching the display, RNG, timers, the stack, Fx0A or memory
+//writes calls the same handler the interpreters use. Registers live in the Chip8 instance, with
+//rbx pointing at it for the whole block.
+
+#ifdef CHIP8_JIT
+
+const size_t JIT_CODE_SIZE = 8 << 20;
+
+namespace {
+
+    using MicroOp = Chip8::BlockCache::MicroOp;
+
+    //Where the state the native code touches lives inside a Chip8.
+    struct Layout {
+        int32_t registers;
+        int32_t pages;
+        int32_t index;
+        int32_t pc;
+        int32_t keypad;
+    };
+
+    //Fx65 finds a byte as pages[address >> 8]->bytes[address & 0xFF].
+    static_assert(MEMORY_PAGE_SIZE == 256 && offsetof(Chip8::Page, bytes) == 0, "Fx65 code assumes 256 byte pages");
+
+    //Just enough of an x86-64 assembler. Memory operands are always [rbx + disp32].
+    class Emitter {
+        public:
+            std::vector<uint8_t> bytes;
+
+            void Byte(uint8_t b){ bytes.push_back(b); }
+            void Bytes(std::initializer_list<uint8_t> list){ bytes.insert(bytes.end(), list); }
+
+            void Imm16(uint16_t v){ Byte(v & 0xFFu); Byte(v >> 8u); }
+
+            void Imm32(uint32_t v){
+                for (int i = 0; i < 4; i++){
+                    Byte((v >> (8 * i)) & 0xFFu);
+                }
+            }
+
+            void Imm64(uint64_t v){
+                for (int i = 0; i < 8; i++){
+                    Byte((v >> (8 * i)) & 0xFFu);
+                }
+            }
+
+            //ModRM for [rbx + disp32] with reg as the register or opcode extension.
+            void Mem(unsigned int reg, int32_t disp){
+                Byte(0x80u | (reg << 3u) | 3u);
+                Imm32(static_cast<uint32_t>(disp));
+            }
+
+            //Emits a rel32 placeholder, returns where it is for Patch().
+            size_t Rel32(){
+                size_t at = bytes.size();
+                Imm32(0);
+                return at;
+            }
+
+            void Patch(size_t at, size_t target){
+                int32_t rel = static_cast<int32_t>(target - (at + 4));
+                std::memcpy(&bytes[at], &rel, sizeof(rel));
+            }
+    };
+
+    enum : uint8_t { AL = 0, CL = 1, DL = 2 };
+
+    //A way out of the block when a control op doesn't go where it went while recording.
+    struct Exit {
+        size_t patch;
+        bool setPc;
+        uint16_t pc;
+        uint32_t executed;
+    };
+
+    //Native version of one instruction. False when it should call its handler instead.
+    bool EmitNative(Emitter& e, Layout const& l, uint16_t opcode){
+        unsigned int x = (opcode & 0x0F00u) >> 8u;
+        unsigned int y = (opcode & 0x00F0u) >> 4u;
+        uint8_t kk = opcode & 0x00FFu;
+        int32_t vx = l.registers + static_cast<int32_t>(x);
+        int32_t vy = l.registers + static_cast<int32_t>(y);
+        int32_t vf = l.registers + 0xF;
+
+        switch (opcode >> 12u){
+            case 0x6:
+                e.Byte(0xC6); e.Mem(0, vx); e.Byte(kk);                         //mov byte [vx], kk
+                return true;
+            case 0x7:
+                e.Byte(0x80); e.Mem(0, vx); e.Byte(kk);                         //add byte [vx], kk
+                return true;
+            case 0xA:
+                e.Bytes({0x66, 0xC7}); e.Mem(0, l.index); e.Imm16(opcode & 0x0FFFu);   //mov word [index], nnn
+                return true;
+            case 0x8:
+                switch (opcode & 0x000Fu){
+                    case 0x0:
+                    case 0x1:
+                    case 0x2:
+                    case 0x3: {
+                        static uint8_t const ops[4] = {0x88, 0x08, 0x20, 0x30};    //mov, or, and, xor [vx], al
+                        e.Byte(0x8A); e.Mem(AL, vy);
+                        e.Byte(ops[opcode & 0x3u]); e.Mem(AL, vx);
+                        return true;
+                    }
+                    case 0x4:
+                        e.Bytes({0x0F, 0xB6}); e.Mem(0, vx);                    //movzx eax, byte [vx]
+                        e.Bytes({0x0F, 0xB6}); e.Mem(1, vy);                    //movzx ecx, byte [vy]
+                        e.Bytes({0x01, 0xC8});                                  //add eax, ecx
+                        e.Byte(0x3D); e.Imm32(255);                             //cmp eax, 255
+                        e.Bytes({0x0F, 0x97, 0xC2});                            //seta dl
+                        e.Byte(0x88); e.Mem(DL, vf);                            //mov [vf], dl
+                        e.Byte(0x88); e.Mem(AL, vx);                            //mov [vx], al
+                        return true;
+                    case 0x5:
+                    case 0x7: {
+                        //Vf first, then the subtraction re-reads both operands in case either is Vf.
+                        int32_t lhs = (opcode & 0x000Fu) == 0x5 ? vx : vy;
+                        int32_t rhs = (opcode & 0x000Fu) == 0x5 ? vy : vx;
+                        e.Byte(0x8A); e.Mem(AL, lhs);                           //mov al, [lhs]
+                        e.Byte(0x3A); e.Mem(AL, rhs);                           //cmp al, [rhs]
+                        e.Bytes({0x0F, 0x97, 0xC2});                            //seta dl
+                        e.Byte(0x88); e.Mem(DL, vf);                            //mov [vf], dl
+                        e.Byte(0x8A); e.Mem(AL, lhs);                           //mov al, [lhs]
+                        e.Byte(0x2A); e.Mem(AL, rhs);                           //sub al, [rhs]
+                        e.Byte(0x88); e.Mem(AL, vx);                            //mov [vx], al
+                        return true;
+                    }
+                    case 0x6:
+                        e.Byte(0x8A); e.Mem(AL, vx);                            //mov al, [vx]
+                        e.Bytes({0x24, 0x01});                                  //and al, 1
+                        e.Byte(0x88); e.Mem(AL, vf);                            //mov [vf], al
+                        e.Byte(0xD0); e.Mem(5, vx);                             //shr byte [vx], 1
+                        return true;
+                    case 0xE:
+                        e.Byte(0x8A); e.Mem(AL, vx);                            //mov al, [vx]
+                        e.Bytes({0xC0, 0xE8, 0x07});                            //shr al, 7
+                        e.Byte(0x88); e.Mem(AL, vf);                            //mov [vf], al
+                        e.Byte(0xD0); e.Mem(4, vx);                             //shl byte [vx], 1
+                        return true;
+                }
+                return false;
+            case 0xF:
+                switch (kk){
+                    case 0x1E:
+                        e.Bytes({0x0F, 0xB6}); e.Mem(0, vx);                    //movzx eax, byte [vx]
+                        e.Byte(0x66); e.Byte(0x01); e.Mem(AL, l.index);         //add word [index], ax
+                        return true;
+                    case 0x29:
+                        e.Bytes({0x0F, 0xB6}); e.Mem(0, vx);                    //movzx eax, byte [vx]
+                        e.Bytes({0x8D, 0x44, 0x80, static_cast<uint8_t>(FONTSET_START)});  //lea eax, [rax + rax * 4 + FONTSET_START]
+                        e.Byte(0x66); e.Byte(0x89); e.Mem(AL, l.index);         //mov word [index], ax
+                        return true;
+                    case 0x65:
+                        for (unsigned int i = 0; i <= x; i++){
+                            e.Bytes({0x0F, 0xB7}); e.Mem(0, l.index);           //movzx eax, word [index]
+                            e.Byte(0x05); e.Imm32(i);                           //add eax, i
+                            e.Byte(0x25); e.Imm32(MEMORY_SIZE - 1);             //and eax, 0xFFF
+                            e.Bytes({0x89, 0xC2});                              //mov edx, eax
+                            e.Bytes({0xC1, 0xEA, 0x08});                        //shr edx, 8
+                            e.Bytes({0x48, 0x8B, 0x94, 0xD3}); e.Imm32(l.pages); //mov rdx, [rbx + rdx * 8 + pages]
+                            e.Bytes({0x0F, 0xB6, 0xC0});                        //movzx eax, al
+                            e.Bytes({0x8A, 0x14, 0x02});                        //mov dl, [rdx + rax]
+                            e.Byte(0x88); e.Mem(DL, l.registers + i);           //mov [vi], dl
+                        }
+                        return true;
+                }
+                return false;
+        }
+        return false;
+    }
+
+    //Native skip: compares and leaves the block if it doesn't go the way it went while recording.
+    bool EmitSkip(Emitter& e, Layout const& l, MicroOp const& micro, uint32_t executed, std::vector<Exit>& exits){
+        uint16_t opcode = micro.opcode;
+        int32_t vx = l.registers + static_cast<int32_t>((opcode & 0x0F00u) >> 8u);
+        int32_t vy = l.registers + static_cast<int32_t>((opcode & 0x00F0u) >> 4u);
+        bool takenIfEqual;
+
+        switch (opcode >> 12u){
+            case 0x3:
+            case 0x4:
+                e.Byte(0x80); e.Mem(7, vx); e.Byte(opcode & 0x00FFu);          //cmp byte [vx], kk
+                takenIfEqual = (opcode >> 12u) == 0x3;
+                break;
+            case 0x5:
+            case 0x9:
+                e.Byte(0x8A); e.Mem(AL, vx);                                    //mov al, [vx]
+                e.Byte(0x3A); e.Mem(AL, vy);                                    //cmp al, [vy]
+                takenIfEqual = (opcode >> 12u) == 0x5;
+                break;
+            case 0xE:
+                if ((opcode & 0x000Fu) != 0x1 && (opcode & 0x000Fu) != 0xE){
+                    return false;
+                }
+                e.Bytes({0x0F, 0xB6}); e.Mem(0, vx);                            //movzx eax, byte [vx]
+                e.Byte(0x83); e.Bytes({0xE0, KEY_COUNT - 1});                   //and eax, 0xF
+                e.Bytes({0x80, 0xBC, 0x03}); e.Imm32(l.keypad); e.Byte(0);      //cmp byte [rbx + rax + keypad], 0
+                takenIfEqual = (opcode & 0x000Fu) == 0x1;
+                break;
+            default:
+                return false;
+        }
+
+        bool recordedTaken = micro.next == static_cast<uint16_t>(micro.pc + 2);
+        bool exitOnEqual = takenIfEqual != recordedTaken;
+
+        e.Bytes({0x0F, static_cast<uint8_t>(exitOnEqual ? 0x84 : 0x85)});      //je/jne exit
+        exits.push_back(Exit{e.Rel32(), true, static_cast<uint16_t>(recordedTaken ? micro.pc : micro.pc + 2), executed});
+        return true;
+    }
+
+    void EmitSetPc(Emitter& e, Layout const& l, uint16_t pc){
+        e.Bytes({0x66, 0xC7}); e.Mem(0, l.pc); e.Imm16(pc);                     //mov word [pc], imm16
+    }
+
+    //Calls the op's interpreter handler with the Chip8 and its Decoded copy in the data area.
+    void EmitCall(Emitter& e, MicroOp const& micro, Chip8::Decoded const* decoded){
+        e.Bytes({0x48, 0x89, 0xDF});                                            //mov rdi, rbx
+        e.Bytes({0x48, 0xBE}); e.Imm64(reinterpret_cast<uintptr_t>(decoded));   //mov rsi, decoded
+        e.Bytes({0x48, 0xB8}); e.Imm64(reinterpret_cast<uintptr_t>(micro.op.run));  //mov rax, handler
+        e.Bytes({0xFF, 0xD0});                                                  //call rax
+    }
+}
+
+    Chip8::BlockCache::~BlockCache(){
+        if (code){
+            munmap(code, JIT_CODE_SIZE);
+            munmap(codeWritable, JIT_CODE_SIZE);
+        }
+    }
+
+    Chip8::BlockCache::NativeBlock Chip8::Ops::CompileBlock(Chip8& c, BlockCache::Block const& block){
+        BlockCache& cache = *c.blockCache;
+
+        //The buffer is mapped twice, executable and writable, and neither view is both. Code is
+        //written through one and run through the other without any protection changes.
+        if (!cache.code){
+            int fd = memfd_create("chip8-jit", MFD_CLOEXEC);
+            void* executable = MAP_FAILED;
+            void* writable = MAP_FAILED;
+
+            if (fd >= 0 && ftruncate(fd, JIT_CODE_SIZE) == 0){
+                executable = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+                writable = mmap(nullptr, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            if (fd >= 0){
+                close(fd);
+            }
+
+            //No executable memory here, the block keeps running in the interpreter.
+            if (executable == MAP_FAILED || writable == MAP_FAILED){
+                if (executable != MAP_FAILED){
+                    munmap(executable, JIT_CODE_SIZE);
+                }
+                if (writable != MAP_FAILED){
+                    munmap(writable, JIT_CODE_SIZE);
+                }
+                return nullptr;
+            }
+            cache.code = static_cast<uint8_t*>(executable);
+            cache.codeWritable = static_cast<uint8_t*>(writable);
+        }
+
+        uint8_t const* base = reinterpret_cast<uint8_t const*>(&c);
+        Layout layout{};
+        layout.registers = static_cast<int32_t>(reinterpret_cast<uint8_t const*>(c.registers) - base);
+        layout.pages = static_cast<int32_t>(reinterpret_cast<uint8_t const*>(c.pages) - base);
+        layout.index = static_cast<int32_t>(reinterpret_cast<uint8_t const*>(&c.index) - base);
+        layout.pc = static_cast<int32_t>(reinterpret_cast<uint8_t const*>(&c.pc) - base);
+        layout.keypad = static_cast<int32_t>(reinterpret_cast<uint8_t const*>(c.keypad) - base);
+
+        //Handlers get Decoded copies stored ahead of the code, the ops vector may move.
+        MicroOp const* ops = &cache.ops[block.firstOp];
+        size_t dataSize = (block.length * sizeof(Decoded) + 15u) & ~size_t(15);
+        uint8_t* data = cache.code + cache.codeUsed;
+        Decoded* decoded = reinterpret_cast<Decoded*>(data);
+
+        if (cache.codeUsed + dataSize >= JIT_CODE_SIZE){
+            return nullptr;
+        }
+
+        Emitter e;
+        std::vector<Exit> exits;
+
+        e.Bytes({0x53, 0x41, 0x54, 0x41, 0x55});                                //push rbx; push r12; push r13
+        e.Bytes({0x48, 0x89, 0xFB});                                            //mov rbx, rdi
+        e.Bytes({0x49, 0x89, 0xF4});                                            //mov r12, rsi
+        e.Bytes({0x45, 0x31, 0xED});                                            //xor r13d, r13d
+        size_t top = e.bytes.size();
+
+        for (uint32_t i = 0; i < block.length; i++){
+            MicroOp const& micro = ops[i];
+
+            if (EmitNative(e, layout, micro.opcode)){
+                continue;
+            }
+            if (EmitSkip(e, layout, micro, i + 1, exits)){
+                continue;
+            }
+
+            //A jump always goes where it went while recording, the block just carries on there.
+            if ((micro.opcode >> 12u) == 0x1){
+                continue;
+            }
+
+            if (micro.control){
+                EmitSetPc(e, layout, micro.pc);
+            }
+            EmitCall(e, micro, &decoded[i]);
+
+            if (micro.end){
+                e.Bytes({0x49, 0x8D, 0x85}); e.Imm32(i + 1);                    //lea rax, [r13 + i + 1]
+                e.Byte(0xE9);                                                   //jmp tail
+                exits.push_back(Exit{e.Rel32(), false, 0, 0});
+            }
+            else if (micro.control){
+                e.Bytes({0x66, 0x81}); e.Mem(7, layout.pc); e.Imm16(micro.next);   //cmp word [pc], next
+                e.Bytes({0x0F, 0x85});                                          //jne exit
+                exits.push_back(Exit{e.Rel32(), false, 0, i + 1});
+            }
+        }
+
+        MicroOp const& last = ops[block.length - 1];
+
+        if (!last.end){
+            EmitSetPc(e, layout, last.next);
+            e.Bytes({0x49, 0x81, 0xC5}); e.Imm32(block.length);                 //add r13, length
+
+            //Loops back to its own start: go round again while a whole pass fits the budget.
+            if (last.next == ops[0].pc - 2){
+                e.Bytes({0x49, 0x81, 0xEC}); e.Imm32(block.length);             //sub r12, length
+                e.Bytes({0x49, 0x81, 0xFC}); e.Imm32(block.length);             //cmp r12, length
+                e.Bytes({0x0F, 0x83});                                          //jae top
+                e.Patch(e.Rel32(), top);
+            }
+            e.Bytes({0x4C, 0x89, 0xE8});                                        //mov rax, r13
+        }
+
+        size_t tail = e.bytes.size();
+        e.Bytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});                          //pop r13; pop r12; pop rbx; ret
+
+        for (Exit const& exit : exits){
+            //The end-of-block jumps straight to the tail, rax is already set.
+            if (exit.executed == 0){
+                e.Patch(exit.patch, tail);
+                continue;
+            }
+
+            e.Patch(exit.patch, e.bytes.size());
+            if (exit.setPc){
+                EmitSetPc(e, layout, exit.pc);
+            }
+            e.Bytes({0x49, 0x8D, 0x85}); e.Imm32(exit.executed);                //lea rax, [r13 + executed]
+            e.Byte(0xE9);                                                       //jmp tail
+            e.Patch(e.Rel32(), tail);
+        }
+
+        if (cache.codeUsed + dataSize + e.bytes.size() > JIT_CODE_SIZE){
+            return nullptr;
+        }
+
+        uint8_t* writable = cache.codeWritable + cache.codeUsed;
+        Decoded* decodedWritable = reinterpret_cast<Decoded*>(writable);
+
+        for (uint32_t i = 0; i < block.length; i++){
+            decodedWritable[i] = ops[i].op;
+        }
+        std::memcpy(writable + dataSize, e.bytes.data(), e.bytes.size());
+
+        uint8_t* entry = data + dataSize;
+        cache.codeUsed = (cache.codeUsed + dataSize + e.bytes.size() + 15u) & ~size_t(15);
+
+        return reinterpret_cast<BlockCache::NativeBlock>(entry);
+    }
+
+#else
+
+    Chip8::BlockCache::~BlockCache() = default;
+
+    //Not reachable, SetDispatch() doesn't select the Jit backend on this platform.
+    Chip8::BlockCache::NativeBlock Chip8::Ops::CompileBlock(Chip8&, BlockCache::Block const&){
+        return nullptr;
+    }
+
+#endif
@@ -3,42 +3,201 @@
     A lot of people say that CHIP-8 is a good beginner system so I have done this to learn more and maybe continue on this path for more complex emulation.
 */
 
-#include <string>
-#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <string>
+#include <thread>
 #include "Chip8.hpp"
+#include "Pacer.hpp"
 #include "Platform.hpp"
+#include "Scheduler.hpp"
+#include "TripleBuffer.hpp"
+
+//Newest completed frame, handed from the emulation thread to the render thread.
+struct Frame {
+    uint64_t rows[VIDEO_HEIGHT];
+    DirtyRows dirty;        //Rows that can differ from the last frame the render thread took.
+};
+
+//State shared between the render (main) thread and the emulation thread.
+struct Shared {
+    TripleBuffer<Frame> frames;
+    std::atomic<uint16_t> keys{};
+    std::atomic<bool> quit{};
+};
+
+struct EmulationStats {
+    uint64_t framesRun{};
+    uint64_t framesDropped{};
+    uint64_t framesPublished{};
+    uint64_t framesSkipped{};
+    JitterStats jitter{};
+};
+
+static DirtyRows Merge(DirtyRows a, DirtyRows b){
+    if (a.Empty()) {
+        return b;
+    }
+    if (b.Empty()) {
+        return a;
+    }
+    return DirtyRows{std::min(a.first, b.first), std::max(a.last, b.last)};
+}
+
+//Emulation thread: runs frames on the scheduler's deadlines and publishes the ones that
+//changed the display. Never waits for the render thread.
+static void Emulate(Chip8& chip8, uint64_t instructionsPerFrame, bool unlimited, Shared& shared, EmulationStats& stats){
+    Scheduler scheduler(instructionsPerFrame, unlimited);
+    FramePacer pacer;
+    bool halted = false;
+    //Rows changed since the last publish the render thread is known to have taken.
+    DirtyRows unseen = chip8.Dirty();
+
+    while (!shared.quit.load(std::memory_order_relaxed)){
+        //Sleep until the next frame is due instead of polling; unlimited mode never waits,
+        //unless the program has halted and only its timers are left running.
+        if (!unlimited) {
+            pacer.WaitUntil(scheduler.NextDeadline());
+        }
+        else if (halted) {
+            pacer.WaitUntil(Scheduler::Clock::now() + std::chrono::nanoseconds(1000000000ull / FRAME_RATE));
+        }
+
+        uint16_t keys = shared.keys.load(std::memory_order_relaxed);
+        for (unsigned int key = 0; key < KEY_COUNT; key++) {
+            chip8.keypad[key] = (keys >> key) & 1u;
+        }
+
+        //Publish once per batch of emulated frames, even if several frames had to be caught up.
+        RunStats run = scheduler.RunDue(chip8, Scheduler::Clock::now());
+        halted = run.frames > 0 ? (run.idle == Idle::Halted || run.idle == Idle::WaitKey) : halted;
+
+        if (run.frames > 0) {
+            //Nothing drawn since the last publish: the render thread has nothing to upload or swap.
+            if (chip8.Dirty().Empty()) {
+                stats.framesSkipped++;
+            }
+            else {
+                //A dropped frame's rows go out with the next one, so they're only forgotten once
+                //the render thread has taken a frame that had them.
+                unseen = Merge(unseen, chip8.Dirty());
+
+                Frame& frame = shared.frames.WriteBuffer();
+                std::memcpy(frame.rows, chip8.video, sizeof(frame.rows));
+                frame.dirty = unseen;
+
+                if (shared.frames.Publish()) {
+                    unseen = chip8.Dirty();
+                }
+                chip8.ClearDirty();
+                stats.framesPublished++;
+            }
+        }
+    }
+
+    stats.framesRun = scheduler.FramesRun();
+    stats.framesDropped = scheduler.FramesDropped();
+    stats.jitter = pacer.Jitter();
+}
 
 int main (int argc, char** argv){
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <Scale> <InstructionsPerFrame> <ROM> [--unlimited] [--scanlines] [--grid] [--dispatch NAME]\n";
         std::exit(EXIT_FAILURE);
     }
 
     int videoScale = std::stoi (argv[1]);
-    int cycleDelay = std::stoi (argv[2]);
+    int instructionsPerFrame = std::stoi (argv[2]);
     char const* romFilename = argv[3];
+    bool unlimited = false;
+    Dispatch dispatch = Dispatch::CHIP8_DEFAULT_DISPATCH;
+    DisplayStyle style;
+
+    for (int i = 4; i < argc; i++) {
+        std::string option = argv[i];
+
+        if (option == "--unlimited") {
+            unlimited = true;
+        }
+        else if (option == "--scanlines") {
+            style.scanlines = true;
+        }
+        else if (option == "--grid") {
+            style.pixelGrid = true;
+        }
+        else if (option == "--dispatch" && i + 1 < argc) {
+            if (!ParseDispatch(argv[++i], dispatch)) {
+                std::cerr << "Unknown dispatch " << argv[i] << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else {
+            std::cerr << "Unknown option " << option << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    if (instructionsPerFrame <= 0) {
+        std::cerr << "InstructionsPerFrame must be at least 1\n";
+        std::exit(EXIT_FAILURE);
+    }
 
     Platform platform("CHIP-8 Emulator", VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT);
+    platform.SetStyle(style);
     Chip8 chip8;
-    chip8.LoadROM(romFilename);
-    int videoPitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
+    chip8.SetDispatch(dispatch);
+
+    if (!chip8.LoadROM(romFilename)) {
+        std::cerr << "Could not load ROM " << romFilename << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    Shared shared;
+    EmulationStats emulation;
+    std::thread emulator(Emulate, std::ref(chip8), instructionsPerFrame, unlimited, std::ref(shared), std::ref(emulation));
 
-    auto lastCycleTime = std::chrono::high_resolution_clock::now();
+    uint8_t keys[KEY_COUNT]{};
     bool quit = false;
 
+    //Render thread: input and presenting. A vsync-blocked swap here never stalls the emulator.
     while (!quit){
-        quit = platform.ProcessInput(chip8.keypad);
+        quit = platform.ProcessInput(keys);
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
+        uint16_t keyMask = 0;
+        for (unsigned int key = 0; key < KEY_COUNT; key++) {
+            keyMask |= (keys[key] ? 1u : 0u) << key;
+        }
+        shared.keys.store(keyMask, std::memory_order_relaxed);
 
-        if (dt > cycleDelay) {
-            lastCycleTime = currentTime;
-            chip8.Cycle();
-            platform.Update(chip8.video, videoPitch);
+        if (shared.frames.Acquire()) {
+            Frame const& frame = shared.frames.ReadBuffer();
+            platform.Update(frame.rows + frame.dirty.first, frame.dirty.first, frame.dirty.last - frame.dirty.first + 1);
+        }
+        else if (platform.WindowExposed()) {
+            platform.Redraw();
+        }
+        else {
+            platform.WaitForEvents(1);
         }
     }
+
+    shared.quit.store(true, std::memory_order_relaxed);
+    emulator.join();
+
+    JitterStats jitter = emulation.jitter;
+    PresentStats present = platform.Stats();
+    uint64_t framesShown = emulation.framesPublished + emulation.framesSkipped;
+    std::cout << "Presenter: " << platform.Backend() << ", upload " << present.uploadUs << " us (" << present.uploadBytes
+              << " bytes), present " << present.presentUs << " us per frame over " << present.frames << " frames\n";
+    std::cout << "Dispatch: " << DispatchName(chip8.GetDispatch()) << "\n";
+    std::cout << "Frames: " << emulation.framesRun << " run, " << emulation.framesDropped << " dropped, "
+              << emulation.framesPublished << " published, " << emulation.framesSkipped << " skipped unchanged ("
+              << (framesShown ? 100.0 * emulation.framesSkipped / framesShown : 0.0) << "%)\n";
+    std::cout << "Frame jitter: mean " << jitter.meanUs << " us, max " << jitter.maxUs << " us, "
+              << jitter.over500Us << " of " << jitter.samples << " frames over 500 us\n";
     return 0;
 
-}; 
\ No newline at end of file
+};
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "Pacer.hpp"
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#endif
+
+    FramePacer::FramePacer(std::chrono::microseconds spin) : spin(spin)
+    {
+    }
+
+    //Coarse part of the wait. On Linux steady_clock is CLOCK_MONOTONIC, so the deadline can be
+    //passed to clock_nanosleep as an absolute time and early wakes by signals just sleep again.
+    //Any other error gives up on sleeping and leaves the rest to WaitUntil()'s spin.
+    void FramePacer::SleepUntil(Clock::time_point wake){
+#if defined(__linux__)
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wake.time_since_epoch()).count();
+        timespec ts;
+        ts.tv_sec = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR){
+        }
+#else
+        std::this_thread::sleep_until(wake);
+#endif
+    }
+
+    //Returns at or just after deadline. Deadlines already in the past return immediately
+    //and are not counted as jitter (the scheduler is catching up).
+    void FramePacer::WaitUntil(Clock::time_point deadline){
+        auto now = Clock::now();
+
+        if (now >= deadline){
+            return;
+        }
+
+        if (deadline - now > spin){
+            SleepUntil(deadline - spin);
+        }
+
+        while ((now = Clock::now()) < deadline){
+            std::this_thread::yield();
+        }
+
+        double lateUs = std::chrono::duration<double, std::micro>(now - deadline).count();
+
+        samples++;
+        totalUs += lateUs;
+        if (lateUs > maxUs){
+            maxUs = lateUs;
+        }
+        if (lateUs > 500.0){
+            over500Us++;
+        }
+    }
+
+    JitterStats FramePacer::Jitter() const{
+        JitterStats stats;
+        stats.samples = samples;
+        stats.meanUs = samples ? totalUs / samples : 0.0;
+        stats.maxUs = maxUs;
+        stats.over500Us = over500Us;
+        return stats;
+    }
+
+    void FramePacer::ResetJitter(){
+        samples = 0;
+        totalUs = 0.0;
+        maxUs = 0.0;
+        over500Us = 0;
+    }
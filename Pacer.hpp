@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+//How long before a deadline the pacer stops sleeping and spins. Windows sleeps are much coarser.
+#if defined(_WIN32)
+const unsigned int PACER_SPIN_US = 2000;
+#else
+const unsigned int PACER_SPIN_US = 300;
+#endif
+
+//Wake-up lateness against the requested deadlines, in microseconds.
+struct JitterStats {
+    uint64_t samples{};
+    double meanUs{};
+    double maxUs{};
+    uint64_t over500Us{};
+};
+
+//Waits for frame deadlines by sleeping until shortly before them and spinning the rest,
+//so an idle emulator uses almost no CPU but still wakes on time.
+class FramePacer {
+
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit FramePacer(std::chrono::microseconds spin = std::chrono::microseconds(PACER_SPIN_US));
+
+        void WaitUntil(Clock::time_point deadline);
+        JitterStats Jitter() const;
+        void ResetJitter();
+
+    private:
+        void SleepUntil(Clock::time_point wake);
+
+        std::chrono::microseconds spin;
+        uint64_t samples{};
+        double totalUs{};
+        double maxUs{};
+        uint64_t over500Us{};
+};
@@ -1,43 +1,339 @@
 #include "Platform.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <glad/glad.h>
 #include <SDL.h>
 
-        Platform::Platform (char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight) {
+//Full-screen triangle from gl_VertexID, texture row 0 at the top.
+static char const* VERTEX_SHADER = R"(#version 330 core
+out vec2 uv;
+void main(){
+    vec2 pos = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);
+    uv = vec2(pos.x + 1.0, 1.0 - pos.y) * 0.5;
+    gl_Position = vec4(pos, 0.0, 1.0);
+}
+)";
+
+//The display arrives as the emulator's uint64_t rows viewed as pairs of 32-bit texels. On a
+//little-endian host the high half of each word (the leftmost 32 pixels) is the second texel.
+static char const* FRAGMENT_SHADER = R"(#version 330 core
+in vec2 uv;
+out vec4 color;
+uniform usampler2D screen;
+uniform ivec2 size;
+uniform vec4 palette[2];
+uniform bool scanlines;
+uniform bool pixelGrid;
+void main(){
+    vec2 position = uv * vec2(size);
+    ivec2 pixel = clamp(ivec2(position), ivec2(0), size - 1);
+    int column = pixel.x & 63;
+    uint word = texelFetch(screen, ivec2((pixel.x >> 6) * 2 + (column < 32 ? 1 : 0), pixel.y), 0).r;
+    color = palette[(word >> uint(31 - (column & 31))) & 1u];
+
+    vec2 cell = fract(position);
+    if (scanlines && cell.y > 0.5) {
+        color.rgb *= 0.6;
+    }
+    if (pixelGrid && (cell.x < 0.08 || cell.y < 0.08)) {
+        color.rgb *= 0.75;
+    }
+}
+)";
+
+        static GLuint CompileShader(GLenum type, char const* source){
+            GLuint shader = glCreateShader(type);
+            GLint ok = GL_FALSE;
+
+            glShaderSource(shader, 1, &source, nullptr);
+            glCompileShader(shader);
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+
+            if (!ok){
+                char log[512];
+                glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+                std::cerr << "Shader compile failed: " << log << "\n";
+                glDeleteShader(shader);
+                return 0;
+            }
+            return shader;
+        }
+
+        Platform::Platform (char const* title, int windowWidth, int windowHeight, int displayWidth, int displayHeight)
+            : displayWidth(displayWidth), displayHeight(displayHeight), rowWords(displayWidth / 64) {
             SDL_Init(SDL_INIT_VIDEO);
 
+            //Prefer GL 4.6 for persistently mapped uploads, then GL 3.3, then SDL's own renderer.
+            if (CreateGL(title, windowWidth, windowHeight, 4, 6) || CreateGL(title, windowWidth, windowHeight, 3, 3)) {
+                backend = upload_memory ? "gl-persistent-pbo" : "gl-texsubimage";
+            }
+            else {
+                CreateRenderer(title, windowWidth, windowHeight);
+                backend = "sdl-renderer";
+            }
+        }
+
+        bool Platform::CreateGL(char const* title, int windowWidth, int windowHeight, int major, int minor){
             SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
-            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 4);
-            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 6);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, major);
+            SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, minor);
 
             window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowWidth, windowHeight, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
-            gl_context = SDL_GL_CreateContext(window);
+            if (window) {
+                gl_context = SDL_GL_CreateContext(window);
+            }
+            if (!gl_context || !gladLoadGLLoader(reinterpret_cast<GLADloadproc>(SDL_GL_GetProcAddress))) {
+                DestroyGL();
+                return false;
+            }
+
             SDL_GL_SetSwapInterval(1);
-	        gladLoadGL();
-
-            	glGenTextures(1, &framebuffer_texture);
-	            glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
-	            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 640, 320, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	            glBindTexture(GL_TEXTURE_2D, 0);
+
+            GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, VERTEX_SHADER);
+            GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+            GLint linked = GL_FALSE;
+
+            if (vertexShader && fragmentShader) {
+                program = glCreateProgram();
+                glAttachShader(program, vertexShader);
+                glAttachShader(program, fragmentShader);
+                glLinkProgram(program);
+                glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            }
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+
+            if (!linked) {
+                DestroyGL();
+                return false;
+            }
+
+            glUseProgram(program);
+            glUniform1i(glGetUniformLocation(program, "screen"), 0);
+            glUniform2i(glGetUniformLocation(program, "size"), displayWidth, displayHeight);
+            SetStyle(style);
+
+            //Core profile needs a bound VAO even though the triangle has no attributes.
+            glGenVertexArrays(1, &vertex_array);
+
+            //1 bit per pixel, two 32-bit texels per emulator row word: 256 bytes for 64x32.
+            glGenTextures(1, &framebuffer_texture);
+            glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32UI, rowWords * 2, displayHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+            //One persistently mapped, coherent buffer split into UPLOAD_RING_SIZE frame slots,
+            //so writing a frame never waits for the driver to copy the previous one.
+            if (GLAD_GL_VERSION_4_4) {
+                GLsizeiptr size = static_cast<GLsizeiptr>(rowWords) * 8 * displayHeight * UPLOAD_RING_SIZE;
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+                glGenBuffers(1, &upload_buffer);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer);
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+                upload_memory = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+
+            return true;
+        }
+
+        void Platform::DestroyGL(){
+            if (gl_context) {
+                for (GLsync& fence : upload_fences) {
+                    if (fence) {
+                        glDeleteSync(fence);
+                        fence = nullptr;
+                    }
+                }
+                if (upload_buffer) {
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer);
+                    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                    glDeleteBuffers(1, &upload_buffer);
+                }
+                if (program) {
+                    glDeleteProgram(program);
+                }
+                glDeleteVertexArrays(1, &vertex_array);
+                glDeleteTextures(1, &framebuffer_texture);
+                SDL_GL_DeleteContext(gl_context);
+            }
+            if (window) {
+                SDL_DestroyWindow(window);
+            }
+
+            upload_buffer = 0;
+            upload_memory = nullptr;
+            program = 0;
+            vertex_array = 0;
+            framebuffer_texture = 0;
+            gl_context = nullptr;
+            window = nullptr;
+        }
+
+        //No usable GL: let SDL pick whatever renderer it has and letterbox to the display size.
+        //The bitplane is expanded on the CPU for this path only.
+        void Platform::CreateRenderer(char const* title, int windowWidth, int windowHeight){
+            window = SDL_CreateWindow(title, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowWidth, windowHeight, SDL_WINDOW_RESIZABLE);
+            if (!window) {
+                std::cerr << "Could not create window: " << SDL_GetError() << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+
+            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+            if (renderer) {
+                texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, displayWidth, displayHeight);
+            }
+            if (!texture) {
+                std::cerr << "Could not create renderer: " << SDL_GetError() << "\n";
+                std::exit(EXIT_FAILURE);
+            }
+
+            SDL_RenderSetLogicalSize(renderer, displayWidth, displayHeight);
+            pixels.resize(static_cast<size_t>(displayWidth) * displayHeight);
+        }
+
+        void Platform::SetStyle(DisplayStyle const& newStyle){
+            style = newStyle;
+
+            if (!program) {
+                return;
+            }
+
+            GLfloat colors[8];
+            for (int i = 0; i < 2; i++) {
+                for (int channel = 0; channel < 4; channel++) {
+                    colors[i * 4 + channel] = ((style.palette.colors[i] >> (24 - channel * 8)) & 0xFFu) / 255.0f;
+                }
+            }
+
+            glUseProgram(program);
+            glUniform4fv(glGetUniformLocation(program, "palette"), 2, colors);
+            glUniform1i(glGetUniformLocation(program, "scanlines"), style.scanlines);
+            glUniform1i(glGetUniformLocation(program, "pixelGrid"), style.pixelGrid);
         }
 
        Platform::~Platform(){
-            SDL_DestroyTexture(texture);
-            SDL_DestroyRenderer(renderer);
-            SDL_DestroyWindow(window);
+            if (renderer) {
+                SDL_DestroyTexture(texture);
+                SDL_DestroyRenderer(renderer);
+                SDL_DestroyWindow(window);
+            }
+            else {
+                DestroyGL();
+            }
             SDL_Quit();
         }
 
-        //Deals with changes
+        //Deals with changes. rows points at the display's firstRow, rowCount rows of it are uploaded.
+
+        void Platform::Update(uint64_t const* rows, int firstRow, int rowCount){
+            auto start = std::chrono::steady_clock::now();
+            size_t rowBytes = static_cast<size_t>(rowWords) * 8;
+
+            if (renderer) {
+                SDL_Rect dirty{0, firstRow, displayWidth, rowCount};
+                uint32_t* dirtyPixels = &pixels[static_cast<size_t>(firstRow) * displayWidth];
+
+                ExpandBitplanes(rows, nullptr, displayWidth, rowCount, style.palette, PixelFormat::RGBA8888, 1, dirtyPixels, displayWidth * 4);
+                SDL_UpdateTexture(texture, &dirty, dirtyPixels, displayWidth * 4);
+                uploadTotalBytes += static_cast<double>(displayWidth) * 4 * rowCount;
+            }
+            else if (upload_memory) {
+                size_t slotOffset = upload_slot * rowBytes * displayHeight;
+                GLsync& fence = upload_fences[upload_slot];
+
+                //The slot was last used UPLOAD_RING_SIZE frames ago, this almost never waits.
+                if (fence) {
+                    glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                    glDeleteSync(fence);
+                }
+
+                std::memcpy(upload_memory + slotOffset, rows, rowBytes * rowCount);
+
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, upload_buffer);
+                glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, rowWords * 2, rowCount, GL_RED_INTEGER, GL_UNSIGNED_INT, reinterpret_cast<void const*>(slotOffset));
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+                fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                upload_slot = (upload_slot + 1) % UPLOAD_RING_SIZE;
+                uploadTotalBytes += static_cast<double>(rowBytes) * rowCount;
+            }
+            else {
+                glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, rowWords * 2, rowCount, GL_RED_INTEGER, GL_UNSIGNED_INT, rows);
+                uploadTotalBytes += static_cast<double>(rowBytes) * rowCount;
+            }
+
+            auto uploaded = std::chrono::steady_clock::now();
+            Redraw();
+            auto presented = std::chrono::steady_clock::now();
+
+            framesPresented++;
+            uploadTotalUs += std::chrono::duration<double, std::micro>(uploaded - start).count();
+            presentTotalUs += std::chrono::duration<double, std::micro>(presented - uploaded).count();
+        }
+
+        //Draws the current texture again, e.g. after the window was resized or uncovered.
+        void Platform::Redraw(){
+            if (renderer) {
+                SDL_RenderClear(renderer);
+                SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+                SDL_RenderPresent(renderer);
+                return;
+            }
+
+            int width = 0;
+            int height = 0;
+            SDL_GL_GetDrawableSize(window, &width, &height);
+
+            //Largest viewport with the texture's aspect ratio, centered in the window.
+            int viewWidth = width;
+            int viewHeight = width * displayHeight / displayWidth;
+            if (viewHeight > height) {
+                viewHeight = height;
+                viewWidth = height * displayWidth / displayHeight;
+            }
+
+            glViewport(0, 0, width, height);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            glViewport((width - viewWidth) / 2, (height - viewHeight) / 2, viewWidth, viewHeight);
+            glUseProgram(program);
+            glBindVertexArray(vertex_array);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, framebuffer_texture);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+
+            SDL_GL_SwapWindow(window);
+        }
+
+        //Blocks until an event is queued (without removing it) or timeoutMs passes.
+        void Platform::WaitForEvents(int timeoutMs){
+            SDL_WaitEventTimeout(nullptr, timeoutMs);
+        }
+
+        //True once after the window was resized or uncovered and needs a Redraw().
+        bool Platform::WindowExposed(){
+            bool wasExposed = exposed;
+            exposed = false;
+            return wasExposed;
+        }
 
-        void Platform::Update(void const* buffer, int pitch){
-            SDL_UpdateTexture(texture, nullptr, buffer, pitch);
-            SDL_RenderClear(renderer);
-            SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-            SDL_RenderPresent(renderer);
+        PresentStats Platform::Stats() const{
+            PresentStats stats;
+            stats.frames = framesPresented;
+            stats.uploadUs = framesPresented ? uploadTotalUs / framesPresented : 0.0;
+            stats.presentUs = framesPresented ? presentTotalUs / framesPresented : 0.0;
+            stats.uploadBytes = framesPresented ? uploadTotalBytes / framesPresented : 0.0;
+            return stats;
         }
 
         //Process events from inputs.
@@ -52,6 +348,12 @@
 					    quit = true;
 				    } break;
 
+				    case SDL_WINDOWEVENT:{
+					    if (event.window.event == SDL_WINDOWEVENT_EXPOSED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED){
+						    exposed = true;
+					    }
+				    } break;
+
 				    case SDL_KEYDOWN:{
 					    switch (event.key.keysym.sym){
 						    case SDLK_ESCAPE:{
@@ -1,24 +1,72 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 #include <glad/glad.h>
-#include <SDL.h>  
+#include <SDL.h>
+#include "Expand.hpp"
 
+//Frames the GPU may still be reading from the upload buffer while the next one is written.
+const unsigned int UPLOAD_RING_SIZE = 3;
+
+//How the 1-bit display is coloured and decorated. Applied by the fragment shader.
+struct DisplayStyle {
+    Palette palette{};
+    bool scanlines{};
+    bool pixelGrid{};
+};
+
+//Average cost of getting a frame on screen, in microseconds and bytes sent to the GPU.
+struct PresentStats {
+    uint64_t frames{};
+    double uploadUs{};
+    double presentUs{};
+    double uploadBytes{};
+};
 
 class Platform {
 
     friend class Imgui;
 
     public:
-        Platform(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight);
+        Platform(char const* title, int windowWidth, int windowHeight, int displayWidth, int displayHeight);
         ~Platform();
-        void Update(void const* buffer, int pitch);
+        void SetStyle(DisplayStyle const& newStyle);
+        void Update(uint64_t const* rows, int firstRow, int rowCount);
+        void Redraw();
         bool ProcessInput(uint8_t* keys);
+        void WaitForEvents(int timeoutMs);
+        bool WindowExposed();
+        char const* Backend() const { return backend; }
+        PresentStats Stats() const;
 
     private:
+        bool CreateGL(char const* title, int windowWidth, int windowHeight, int major, int minor);
+        void DestroyGL();
+        void CreateRenderer(char const* title, int windowWidth, int windowHeight);
+
         SDL_Window* window{};
         SDL_Renderer* renderer{};
         SDL_Texture* texture{};
         SDL_GLContext gl_context{};
-        GLuint framebuffer_texture; 
-};
\ No newline at end of file
+        GLuint framebuffer_texture{};
+        GLuint program{};
+        GLuint vertex_array{};
+        GLuint upload_buffer{};
+        uint8_t* upload_memory{};
+        GLsync upload_fences[UPLOAD_RING_SIZE]{};
+        unsigned int upload_slot{};
+
+        int displayWidth{};
+        int displayHeight{};
+        int rowWords{};
+        DisplayStyle style{};
+        std::vector<uint32_t> pixels;
+        char const* backend{};
+        bool exposed{};
+
+        uint64_t framesPresented{};
+        double uploadTotalUs{};
+        double presentTotalUs{};
+        double uploadTotalBytes{};
+};
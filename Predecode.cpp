@@ -0,0 +1,258 @@
+#include "Chip8.hpp"
+#include "Chip8Ops.hpp"
+#include <cstdint>
+
+//Predecoded backend. Each address gets its instruction decoded once, the first time it runs,
+//and the entry is reused until something writes to the bytes it was decoded from. Common
+//sequences are fused into superinstructions that run two or three instructions per dispatch.
+
+namespace {
+
+    using Decoded = Chip8::Decoded;
+    using Ops = Chip8::Ops;
+
+    void OpNull(Chip8&, Decoded const&){}
+    void Op00E0(Chip8& c, Decoded const&){ Ops::Cls(c); }
+    void Op00EE(Chip8& c, Decoded const&){ Ops::Ret(c); }
+    void Op1nnn(Chip8& c, Decoded const& d){ Ops::Jump(c, d.nnn); }
+    void Op2nnn(Chip8& c, Decoded const& d){ Ops::Call(c, d.nnn); }
+    void Op3xkk(Chip8& c, Decoded const& d){ Ops::SkipIfEqual(c, d.x, d.kk); }
+    void Op4xkk(Chip8& c, Decoded const& d){ Ops::SkipIfNotEqual(c, d.x, d.kk); }
+    void Op5xy0(Chip8& c, Decoded const& d){ Ops::SkipIfRegistersEqual(c, d.x, d.y); }
+    void Op6xkk(Chip8& c, Decoded const& d){ Ops::Set(c, d.x, d.kk); }
+    void Op7xkk(Chip8& c, Decoded const& d){ Ops::AddImmediate(c, d.x, d.kk); }
+    void Op8xy0(Chip8& c, Decoded const& d){ Ops::Move(c, d.x, d.y); }
+    void Op8xy1(Chip8& c, Decoded const& d){ Ops::Or(c, d.x, d.y); }
+    void Op8xy2(Chip8& c, Decoded const& d){ Ops::And(c, d.x, d.y); }
+    void Op8xy3(Chip8& c, Decoded const& d){ Ops::Xor(c, d.x, d.y); }
+    void Op8xy4(Chip8& c, Decoded const& d){ Ops::Add(c, d.x, d.y); }
+    void Op8xy5(Chip8& c, Decoded const& d){ Ops::Sub(c, d.x, d.y); }
+    void Op8xy6(Chip8& c, Decoded const& d){ Ops::ShiftRight(c, d.x); }
+    void Op8xy7(Chip8& c, Decoded const& d){ Ops::SubReverse(c, d.x, d.y); }
+    void Op8xyE(Chip8& c, Decoded const& d){ Ops::ShiftLeft(c, d.x); }
+    void Op9xy0(Chip8& c, Decoded const& d){ Ops::SkipIfRegistersNotEqual(c, d.x, d.y); }
+    void OpAnnn(Chip8& c, Decoded const& d){ Ops::SetIndex(c, d.nnn); }
+    void OpBnnn(Chip8& c, Decoded const& d){ Ops::JumpOffset(c, d.nnn); }
+    void OpCxkk(Chip8& c, Decoded const& d){ Ops::Random(c, d.x, d.kk); }
+    void OpDxyn(Chip8& c, Decoded const& d){ Ops::Draw(c, d.x, d.y, d.n); }
+    void OpEx9E(Chip8& c, Decoded const& d){ Ops::SkipIfKey(c, d.x); }
+    void OpExA1(Chip8& c, Decoded const& d){ Ops::SkipIfNotKey(c, d.x); }
+    void OpFx07(Chip8& c, Decoded const& d){ Ops::GetDelay(c, d.x); }
+    void OpFx0A(Chip8& c, Decoded const& d){ Ops::WaitKey(c, d.x); }
+    void OpFx15(Chip8& c, Decoded const& d){ Ops::SetDelay(c, d.x); }
+    void OpFx18(Chip8& c, Decoded const& d){ Ops::SetSound(c, d.x); }
+    void OpFx1E(Chip8& c, Decoded const& d){ Ops::AddIndex(c, d.x); }
+    void OpFx29(Chip8& c, Decoded const& d){ Ops::FontCharacter(c, d.x); }
+    void OpFx33(Chip8& c, Decoded const& d){ Ops::Bcd(c, d.x); }
+    void OpFx55(Chip8& c, Decoded const& d){ Ops::Store(c, d.x); }
+    void OpFx65(Chip8& c, Decoded const& d){ Ops::Load(c, d.x); }
+
+    using Handler = void (*)(Chip8& c, Decoded const& d);
+
+    //Two instructions in a row, the first one leaves pc alone.
+    template <Handler First, Handler Second>
+    void Fused(Chip8& c, Decoded const& d){
+        First(c, d);
+        Ops::Jump(c, c.PC() + 2);
+        Second(c, (&d)[2]);
+    }
+
+    //A skip and the instruction it skips. When it does skip, the instruction after runs instead,
+    //so the superinstruction runs the same number of instructions either way.
+    template <Handler Skip, Handler Then>
+    void FusedSkip(Chip8& c, Decoded const& d){
+        uint16_t next = c.PC();
+        Skip(c, d);
+
+        if (c.PC() == next){
+            Ops::Jump(c, next + 2);
+            Then(c, (&d)[2]);
+        }
+        else {
+            Ops::RunFusedTail(c);
+        }
+    }
+
+    struct Fusion {
+        unsigned int length;
+        uint16_t mask[MAX_FUSED];
+        uint16_t value[MAX_FUSED];
+        Handler run;
+    };
+
+    //The most frequent sequences in chip8-headless --profile-pairs, longest first.
+    Fusion const FUSIONS[] = {
+        {3, {0xF000, 0xF000, 0xF000}, {0x7000, 0x3000, 0x1000}, &Fused<Op7xkk, FusedSkip<Op3xkk, Op1nnn>>},    //Counting loop
+        {3, {0xF0FF, 0xF000, 0xF000}, {0xF007, 0x3000, 0x1000}, &Fused<OpFx07, FusedSkip<Op3xkk, Op1nnn>>},    //Delay timer wait
+        {2, {0xF000, 0xF000}, {0x3000, 0x1000}, &FusedSkip<Op3xkk, Op1nnn>},
+        {2, {0xF000, 0xF000}, {0x7000, 0x3000}, &Fused<Op7xkk, Op3xkk>},
+        {2, {0xF000, 0xF000}, {0xA000, 0xD000}, &Fused<OpAnnn, OpDxyn>},
+        {2, {0xF000, 0xF000}, {0x6000, 0x6000}, &Fused<Op6xkk, Op6xkk>},
+    };
+
+}
+
+    //Same decoding as the function pointer tables, aliases and no-ops included.
+    Chip8::Decoded Chip8::Ops::DecodeOpcode(uint16_t opcode){
+        Decoded d{};
+        d.nnn = opcode & 0x0FFFu;
+        d.x = (opcode & 0x0F00u) >> 8u;
+        d.y = (opcode & 0x00F0u) >> 4u;
+        d.kk = opcode & 0x00FFu;
+        d.n = opcode & 0x000Fu;
+        d.run = &OpNull;
+        d.length = 1;
+
+        switch (opcode >> 12u){
+            case 0x0:
+                if (d.n == 0x0){ d.run = &Op00E0; }
+                if (d.n == 0xE){ d.run = &Op00EE; }
+                break;
+            case 0x1: d.run = &Op1nnn; break;
+            case 0x2: d.run = &Op2nnn; break;
+            case 0x3: d.run = &Op3xkk; break;
+            case 0x4: d.run = &Op4xkk; break;
+            case 0x5: d.run = &Op5xy0; break;
+            case 0x6: d.run = &Op6xkk; break;
+            case 0x7: d.run = &Op7xkk; break;
+            case 0x8:
+                switch (d.n){
+                    case 0x0: d.run = &Op8xy0; break;
+                    case 0x1: d.run = &Op8xy1; break;
+                    case 0x2: d.run = &Op8xy2; break;
+                    case 0x3: d.run = &Op8xy3; break;
+                    case 0x4: d.run = &Op8xy4; break;
+                    case 0x5: d.run = &Op8xy5; break;
+                    case 0x6: d.run = &Op8xy6; break;
+                    case 0x7: d.run = &Op8xy7; break;
+                    case 0xE: d.run = &Op8xyE; break;
+                }
+                break;
+            case 0x9: d.run = &Op9xy0; break;
+            case 0xA: d.run = &OpAnnn; break;
+            case 0xB: d.run = &OpBnnn; break;
+            case 0xC: d.run = &OpCxkk; break;
+            case 0xD: d.run = &OpDxyn; break;
+            case 0xE:
+                if (d.n == 0x1){ d.run = &OpExA1; }
+                if (d.n == 0xE){ d.run = &OpEx9E; }
+                break;
+            case 0xF:
+                switch (d.kk){
+                    case 0x07: d.run = &OpFx07; break;
+                    case 0x0A: d.run = &OpFx0A; break;
+                    case 0x15: d.run = &OpFx15; break;
+                    case 0x18: d.run = &OpFx18; break;
+                    case 0x1E: d.run = &OpFx1E; break;
+                    case 0x29: d.run = &OpFx29; break;
+                    case 0x33: d.run = &OpFx33; break;
+                    case 0x55: d.run = &OpFx55; break;
+                    case 0x65: d.run = &OpFx65; break;
+                }
+                break;
+        }
+        return d;
+    }
+
+    //The superinstruction starting with first at address, or first itself. Entries a fused
+    //handler reads its other operands from are decoded now if they haven't been yet.
+    Chip8::Decoded Chip8::Ops::Fuse(Chip8& c, unsigned int address, Decoded const& first){
+        for (Fusion const& fusion : FUSIONS){
+            bool match = address + 2 * fusion.length <= MEMORY_SIZE;
+
+            for (unsigned int i = 0; match && i < fusion.length; i++){
+                match = (Fetch(c, address + 2 * i) & fusion.mask[i]) == fusion.value[i];
+            }
+            if (!match){
+                continue;
+            }
+
+            for (unsigned int i = 1; i < fusion.length; i++){
+                Decoded& next = c.predecoded[address + 2 * i];
+                if (next.run == &PredecodeMiss){
+                    next = DecodeOpcode(Fetch(c, address + 2 * i));
+                }
+            }
+
+            Decoded fused = first;
+            fused.run = fusion.run;
+            fused.length = static_cast<uint8_t>(fusion.length);
+            return fused;
+        }
+        return first;
+    }
+
+    //Handler of an entry that hasn't been decoded yet. pc has already moved past the instruction.
+    //Only runs this one instruction, even when the entry becomes a superinstruction.
+    void Chip8::Ops::PredecodeMiss(Chip8& c, Decoded const&){
+        unsigned int address = (c.pc - 2) & (MEMORY_SIZE - 1);
+        Decoded d = DecodeOpcode(Fetch(c, address));
+
+        c.predecoded[address] = Fuse(c, address, d);
+        d.run(c, d);
+    }
+
+    //The instruction after a superinstruction's skip, run on its own.
+    void Chip8::Ops::RunFusedTail(Chip8& c){
+        Decoded const& d = c.predecoded[c.pc & (MEMORY_SIZE - 1)];
+
+        if (d.length == 1){
+            c.pc += 2;
+            d.run(c, d);
+            return;
+        }
+
+        Decoded single = DecodeOpcode(FetchNext(c));
+        single.run(c, single);
+    }
+
+    uint64_t Chip8::Ops::RunPredecoded(Chip8& c, uint64_t count){
+        if (!c.predecoded){
+            c.predecoded.reset(new Decoded[MEMORY_SIZE]);
+            InvalidatePredecoded(c, 0, MEMORY_SIZE);
+        }
+
+        Decoded const* cache = c.predecoded.get();
+        uint64_t i = 0;
+
+        while (i < count){
+            Decoded const& d = cache[c.pc & (MEMORY_SIZE - 1)];
+            unsigned int length = d.length;
+
+            //A superinstruction that doesn't fit in what's left of the budget runs unfused.
+            if (length > count - i){
+                Decoded single = DecodeOpcode(FetchNext(c));
+                single.run(c, single);
+                i++;
+            }
+            else {
+                //length is read first: the handler can overwrite its own entry.
+                c.pc += 2;
+                d.run(c, d);
+                i += length;
+            }
+
+            //Fx0A is never fused ahead of anything, so a blocked one is the last of the group.
+            if (c.waitingForKey){
+                return i - 1;
+            }
+        }
+        return count;
+    }
+
+    //An entry is decoded from up to MAX_FUSED instructions starting at its address, so the
+    //entries just before the written range go too.
+    void Chip8::Ops::InvalidatePredecoded(Chip8& c, unsigned int address, unsigned int length){
+        if (length >= MEMORY_SIZE){
+            address = 0;
+            length = MEMORY_SIZE - 1;
+        }
+
+        unsigned int reach = 2 * MAX_FUSED - 1;
+
+        for (unsigned int i = 0; i < length + reach && i < MEMORY_SIZE; i++){
+            Decoded& entry = c.predecoded[(address - reach + i) & (MEMORY_SIZE - 1)];
+            entry.run = &PredecodeMiss;
+            entry.length = 1;
+        }
+    }
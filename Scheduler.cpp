@@ -0,0 +1,58 @@
+#include "Scheduler.hpp"
+
+    Scheduler::Scheduler(uint64_t instructionsPerFrame, bool unlimited)
+        : instructionsPerFrame(instructionsPerFrame), unlimited(unlimited), origin(Clock::now())
+    {
+    }
+
+    //Start counting frames from now, e.g. after the emulator was paused.
+    void Scheduler::Reset(Clock::time_point now){
+        origin = now;
+        frame = 0;
+    }
+
+    //Frame n starts exactly n/60 s after the origin, in integer nanoseconds.
+    Scheduler::Clock::time_point Scheduler::Deadline(uint64_t n) const{
+        return origin + std::chrono::nanoseconds(n * 1000000000ull / FRAME_RATE);
+    }
+
+    Scheduler::Clock::time_point Scheduler::NextDeadline() const{
+        return unlimited ? Clock::time_point::min() : Deadline(frame);
+    }
+
+    //Runs every frame whose deadline has passed. Unlimited mode runs one frame per call
+    //and never waits. The caller presents once after this returns with frames > 0.
+    RunStats Scheduler::RunDue(Chip8& chip8, Clock::time_point now){
+        RunStats stats;
+        uint64_t due = 1;
+
+        if (!unlimited){
+            if (now < Deadline(frame)){
+                return stats;
+            }
+
+            //Frames due = frames whose start time is <= now.
+            due = std::chrono::duration_cast<std::chrono::nanoseconds>(now - origin).count() * FRAME_RATE / 1000000000ull + 1 - frame;
+
+            //After a long stall (window drag, debugger) start over instead of fast-forwarding.
+            if (due > MAX_CATCHUP_FRAMES){
+                framesDropped += due - 1;
+                Reset(now);
+                due = 1;
+            }
+        }
+
+        for (uint64_t i = 0; i < due; i++){
+            RunStats frameStats = chip8.RunUntilFrameEnd(instructionsPerFrame);
+
+            stats.instructions += frameStats.instructions;
+            stats.frames += frameStats.frames;
+            stats.displayChanged |= frameStats.displayChanged;
+            stats.skipped += frameStats.skipped;
+            stats.idle = frameStats.idle;
+        }
+
+        frame += due;
+        framesRun += due;
+        return stats;
+    }
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "Chip8.hpp"
+
+const unsigned int FRAME_RATE = 60;
+const unsigned int MAX_CATCHUP_FRAMES = 6;
+
+//Runs the Chip8 one emulated frame (instructionsPerFrame instructions + a 60 Hz timer tick) at a time.
+//Deadlines are computed from the frame number so they never drift, however long the session runs.
+class Scheduler {
+
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        Scheduler(uint64_t instructionsPerFrame, bool unlimited);
+
+        RunStats RunDue(Chip8& chip8, Clock::time_point now);
+        Clock::time_point NextDeadline() const;
+        void Reset(Clock::time_point now);
+
+        uint64_t InstructionsPerFrame() const { return instructionsPerFrame; }
+        bool Unlimited() const { return unlimited; }
+        uint64_t FramesRun() const { return framesRun; }
+        uint64_t FramesDropped() const { return framesDropped; }
+
+    private:
+        Clock::time_point Deadline(uint64_t frame) const;
+
+        uint64_t instructionsPerFrame;
+        bool unlimited;
+        Clock::time_point origin;
+        uint64_t frame{};
+        uint64_t framesRun{};
+        uint64_t framesDropped{};
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//Single-producer/single-consumer handoff of the newest value without locks. The producer
+//always has a slot to write into and the consumer always has a complete slot to read,
+//neither ever waits for the other; values the consumer was too slow to see are dropped.
+template <typename T>
+class TripleBuffer {
+
+    public:
+        //Producer side.
+        T& WriteBuffer() { return slots[back].value; }
+
+        //Returns false if the value published before this one was dropped, never acquired.
+        bool Publish(){
+            uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+            back = previous & INDEX;
+            return !(previous & FRESH);
+        }
+
+        //Consumer side. Returns true and swaps in the newest value if one was published since the last call.
+        bool Acquire(){
+            if (!(middle.load(std::memory_order_relaxed) & FRESH)){
+                return false;
+            }
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        T const& ReadBuffer() const { return slots[front].value; }
+
+    private:
+        static const uint8_t INDEX = 0x3;
+        static const uint8_t FRESH = 0x4;
+
+        struct alignas(64) Slot {
+            T value{};
+        };
+
+        Slot slots[3];
+        alignas(64) std::atomic<uint8_t> middle{1};
+        alignas(64) uint8_t back{0};
+        alignas(64) uint8_t front{2};
+};